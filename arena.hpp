@@ -0,0 +1,177 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+#include "voxel.hpp"
+
+namespace vox
+{
+    // bump allocator handing out Octree nodes from large slabs, nodes are never destructed
+    // individually and all of them die together with the arena
+    class OctreeArena
+    {
+        static constexpr size_t SLAB_NODES = 1 << 16;
+
+        std::vector<std::unique_ptr<std::byte[]>> slabs;
+        size_t slab_used = SLAB_NODES;
+        size_t allocated = 0;
+
+    public:
+        OctreeArena() = default;
+        OctreeArena(OctreeArena &&) noexcept = default;
+        OctreeArena &operator=(OctreeArena &&) noexcept = default;
+        OctreeArena(const OctreeArena &) = delete;
+        OctreeArena &operator=(const OctreeArena &) = delete;
+
+        template<typename... Args>
+        Octree *make(Args &&...args);
+        // takes over every slab of other, nodes of both stay valid
+        void adopt(OctreeArena &&other);
+        void clear();
+        [[nodiscard]] size_t size() const;
+        [[nodiscard]] size_t bytes() const;
+    };
+
+    template<typename... Args>
+    Octree *OctreeArena::make(Args &&...args)
+    {
+        if (slab_used == SLAB_NODES)
+        {
+            slabs.push_back(std::make_unique_for_overwrite<std::byte[]>(SLAB_NODES * sizeof(Octree)));
+            slab_used = 0;
+        }
+
+        void *slot = slabs.back().get() + slab_used++ * sizeof(Octree);
+        allocated++;
+        return new (slot) Octree(std::forward<Args>(args)...);
+    }
+
+    inline void OctreeArena::adopt(OctreeArena &&other)
+    {
+        if (other.slabs.empty()) return;
+
+        // own partially filled slab stays last so allocation continues in it
+        if (slabs.empty())
+        {
+            slabs = std::move(other.slabs);
+            slab_used = other.slab_used;
+        }
+        else slabs.insert(
+            slabs.end() - 1,
+            std::make_move_iterator(other.slabs.begin()),
+            std::make_move_iterator(other.slabs.end())
+        );
+        allocated += other.allocated;
+        other.clear();
+    }
+
+    inline void OctreeArena::clear()
+    {
+        slabs.clear();
+        slab_used = SLAB_NODES;
+        allocated = 0;
+    }
+
+    inline size_t OctreeArena::size() const
+    {
+        return allocated;
+    }
+
+    inline size_t OctreeArena::bytes() const
+    {
+        return slabs.size() * SLAB_NODES * sizeof(Octree);
+    }
+
+    // allocates from the arena when given one, from the heap otherwise
+    template<typename... Args>
+    Octree *allocOctree(OctreeArena *arena, Args &&...args)
+    {
+        if (arena) return arena->make(std::forward<Args>(args)...);
+        return new Octree(std::forward<Args>(args)...);
+    }
+
+    // subtrees of one split level in DCENTERS digit order, 8^n of them; siblings are adjacent, so they fold
+    // into parents level by level until the root is left
+    inline Octree *foldSubtrees(std::vector<Octree *> subtrees, OctreeArena *arena)
+    {
+        while (subtrees.size() > 1)
+        {
+            std::vector<Octree *> parents(subtrees.size() / 8);
+            for (size_t i = 0; i < parents.size(); i++)
+            {
+                std::array<Octree *, 8> children{};
+                std::copy_n(subtrees.begin() + static_cast<std::ptrdiff_t>(i * 8), 8, children.begin());
+                parents[i] = allocOctree(arena, children);
+            }
+            subtrees.swap(parents);
+        }
+        return subtrees[0];
+    }
+
+    // owns a tree together with the arena its nodes live in
+    class OctreeHandle
+    {
+        OctreeArena arena;
+        Octree *root = nullptr;
+
+    public:
+        OctreeHandle() = default;
+        OctreeHandle(OctreeArena &&_arena, Octree *_root);
+        OctreeHandle(OctreeHandle &&) noexcept = default;
+        OctreeHandle &operator=(OctreeHandle &&) noexcept = default;
+
+        [[nodiscard]] Octree *get() const;
+        Octree *operator->() const;
+        [[nodiscard]] const OctreeArena &get_arena() const;
+        [[nodiscard]] OctreeArena &get_arena();
+        void reset();
+    };
+
+    inline OctreeHandle::OctreeHandle(OctreeArena &&_arena, Octree *_root)
+    {
+        arena = std::move(_arena);
+        root = _root;
+    }
+
+    inline Octree *OctreeHandle::get() const
+    {
+        return root;
+    }
+
+    inline Octree *OctreeHandle::operator->() const
+    {
+        return root;
+    }
+
+    inline const OctreeArena &OctreeHandle::get_arena() const
+    {
+        return arena;
+    }
+
+    // edits of an arena tree allocate their new nodes here
+    inline OctreeArena &OctreeHandle::get_arena()
+    {
+        return arena;
+    }
+
+    inline void OctreeHandle::reset()
+    {
+        root = nullptr;
+        arena.clear();
+    }
+
+    // runs build(arena) and wraps the returned root, e.g.
+    // makeTree([&](OctreeArena &a) { return genericVolume(f, c, 0.5, 9, color, &a); })
+    template<typename Build>
+    OctreeHandle makeTree(Build build)
+    {
+        OctreeArena arena;
+        Octree *root = build(arena);
+        return {std::move(arena), root};
+    }
+}
@@ -0,0 +1,273 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <glm/vec3.hpp>
+#include "voxel.hpp"
+#include "morton.hpp"
+#include "generators.hpp"
+#include "arena.hpp"
+#include "pool.hpp"
+#include "queue.hpp"
+
+namespace vox
+{
+    // instances a worker finished, they take over the cell (depth, path) from whatever was drawn there
+    struct InstanceBatch
+    {
+        int depth = 0;
+        uint64_t path = 0;
+        std::vector<glm::vec3> color;
+        std::vector<uint64_t> location;
+        std::vector<int32_t> level;
+    };
+
+    // same order and addressing as LinVox::linearize, starting below the batch's cell
+    inline void linearizeBatch(const Octree *node, const int depth, const uint64_t path, InstanceBatch &batch)
+    {
+        if (node->empty()) return;
+        if (depth > MAX_DEPTH) throw std::runtime_error("Octree deeper than 64 bit locations can address.");
+        if (node->leaf())
+        {
+            batch.color.push_back(node->get_color());
+            batch.location.push_back(path);
+            batch.level.push_back(depth);
+            return;
+        }
+        for (int i = 0; i < 8; i++)
+            linearizeBatch(node->get_children()[i], depth + 1, path + (static_cast<uint64_t>(i) << 3 * depth), batch);
+    }
+
+    // builds a model on worker threads while the render thread draws what has arrived. a preview of the whole
+    // model at coarse_depth goes out first, then every coarse cell is built at full depth on its own and
+    // replaces its part of the preview, so the picture sharpens cell by cell
+    class AsyncBuild
+    {
+    public:
+        // builds the cell around center with half extent norm, depth levels deep, into arena. cell is the
+        // cell's index at coarse_depth in DCENTERS digit order, or PREVIEW for the coarse pass over the root
+        using CellBuilder = std::function<Octree *(size_t cell, glm::vec3 center, float norm, int depth, OctreeArena &arena)>;
+        static constexpr size_t PREVIEW = SIZE_MAX;
+
+    private:
+        CellBuilder build;
+        int max_depth;
+        int coarse_depth;
+        BoundedQueue<InstanceBatch> queue;
+        size_t cell_count;
+        std::vector<Octree *> subtrees;
+        OctreeArena arena;
+        std::mutex arena_mutex;
+        std::atomic<size_t> cells_done = 0;
+        std::atomic<bool> cancelled = false;
+        std::atomic<bool> failed = false;
+        mutable std::mutex error_mutex;
+        std::exception_ptr first_error = nullptr;
+        ThreadPool pool;
+
+        void fail(std::exception_ptr error);
+        void publish(InstanceBatch &&batch);
+        void build_cell(size_t cell, glm::vec3 center, float norm, uint64_t path);
+
+    public:
+        AsyncBuild(CellBuilder _build, int _max_depth, int _coarse_depth = 2,
+                   unsigned thread_count = std::thread::hardware_concurrency(), size_t queue_capacity = 256);
+        ~AsyncBuild();
+        AsyncBuild(const AsyncBuild &) = delete;
+        AsyncBuild &operator=(const AsyncBuild &) = delete;
+
+        // render thread side, never blocks
+        bool poll(InstanceBatch &batch);
+        // a failed cell still counts as done, so done() is reached either way and error() tells them apart
+        [[nodiscard]] bool done() const;
+        [[nodiscard]] float progress() const;
+        // the first exception a builder threw, null while every cell succeeded
+        [[nodiscard]] std::exception_ptr error() const;
+        // waits for the build and assembles the cells into one tree, for culling, edits or level of detail;
+        // rethrows error() instead when a cell failed
+        OctreeHandle take();
+    };
+
+    inline AsyncBuild::AsyncBuild(CellBuilder _build, const int _max_depth, const int _coarse_depth,
+                                  const unsigned thread_count, const size_t queue_capacity)
+        : build(std::move(_build)), max_depth(_max_depth), coarse_depth(std::clamp(_coarse_depth, 0, _max_depth)),
+          queue(queue_capacity), cell_count(static_cast<size_t>(1) << 3 * coarse_depth), subtrees(cell_count), pool(thread_count)
+    {
+        pool.submit([this]
+        {
+            // a failed preview fails the build like a failed cell
+            if (coarse_depth > 0)
+            {
+                try
+                {
+                    OctreeArena scratch;
+                    InstanceBatch preview;
+                    linearizeBatch(build(PREVIEW, glm::vec3{0, 0, 0}, 0.5f, coarse_depth, scratch), 0, 0, preview);
+                    publish(std::move(preview));
+                }
+                catch (...)
+                {
+                    fail(std::current_exception());
+                }
+            }
+
+            // cells are queued in index order, each split level goes out before the next one starts
+            std::vector<std::pair<glm::vec3, uint64_t>> cells{{glm::vec3{0, 0, 0}, 0}};
+            float norm = 0.5f;
+            for (int depth = 0; depth < coarse_depth; depth++)
+            {
+                std::vector<std::pair<glm::vec3, uint64_t>> children;
+                children.reserve(cells.size() * 8);
+                for (const auto &[center, path] : cells)
+                    for (int i = 0; i < 8; i++)
+                        children.emplace_back(DCENTERS[i] * norm * 0.5f + center, path + (static_cast<uint64_t>(i) << 3 * depth));
+                cells.swap(children);
+                norm *= 0.5f;
+            }
+
+            for (size_t cell = 0; cell < cells.size(); cell++)
+                pool.submit([this, cell, center = cells[cell].first, norm, path = cells[cell].second]
+                {
+                    build_cell(cell, center, norm, path);
+                });
+        });
+    }
+
+    // stops handing out work, cells that already started still finish. errors stay in error(), a destructor
+    // has nowhere to throw them
+    inline AsyncBuild::~AsyncBuild()
+    {
+        cancelled = true;
+        try
+        {
+            pool.wait();
+        }
+        catch (...)
+        {
+        }
+    }
+
+    inline void AsyncBuild::fail(std::exception_ptr error)
+    {
+        std::lock_guard lock(error_mutex);
+        if (!first_error) first_error = std::move(error);
+        failed = true;
+    }
+
+    // once a cell failed the tree can not be assembled anymore, the remaining cells only count themselves done
+    inline void AsyncBuild::build_cell(const size_t cell, const glm::vec3 center, const float norm, const uint64_t path)
+    {
+        if (cancelled) return;
+
+        if (!failed)
+        {
+            try
+            {
+                OctreeArena local;
+                Octree *subtree = build(cell, center, norm, max_depth - coarse_depth, local);
+
+                InstanceBatch batch;
+                batch.depth = coarse_depth;
+                batch.path = path;
+                linearizeBatch(subtree, coarse_depth, path, batch);
+
+                {
+                    std::lock_guard lock(arena_mutex);
+                    arena.adopt(std::move(local));
+                    subtrees[cell] = subtree;
+                }
+                publish(std::move(batch));
+            }
+            catch (...)
+            {
+                fail(std::current_exception());
+            }
+        }
+        ++cells_done;
+    }
+
+    // a full queue means the render thread is behind, the worker backs off instead of piling up batches
+    inline void AsyncBuild::publish(InstanceBatch &&batch)
+    {
+        while (!queue.try_push(std::move(batch)))
+        {
+            if (cancelled) return;
+            std::this_thread::yield();
+        }
+    }
+
+    inline bool AsyncBuild::poll(InstanceBatch &batch)
+    {
+        return queue.try_pop(batch);
+    }
+
+    inline bool AsyncBuild::done() const
+    {
+        return cells_done == cell_count;
+    }
+
+    inline float AsyncBuild::progress() const
+    {
+        return static_cast<float>(cells_done) / static_cast<float>(cell_count);
+    }
+
+    inline std::exception_ptr AsyncBuild::error() const
+    {
+        std::lock_guard lock(error_mutex);
+        return first_error;
+    }
+
+    inline OctreeHandle AsyncBuild::take()
+    {
+        pool.wait();
+        if (const std::exception_ptr failure = error()) std::rethrow_exception(failure);
+        if (subtrees.empty()) throw std::runtime_error("Asynchronously built tree was already taken.");
+
+        Octree *root = foldSubtrees(std::move(subtrees), &arena);
+        subtrees.clear();
+        return {std::move(arena), root};
+    }
+
+    // volume cells just evaluate the predicate over their own cell; the preview samples it at coarse_depth
+    template<typename F>
+    AsyncBuild::CellBuilder volumeCells(F enclosed, const glm::vec3 color)
+    {
+        return [enclosed = std::move(enclosed), color](size_t, const glm::vec3 center, const float norm, const int depth, OctreeArena &arena)
+        {
+            return genericVolume(enclosed, center, norm, depth, color, &arena);
+        };
+    }
+
+    // buckets the points by coarse cell once, so no cell build scans the whole cloud; the preview is built
+    // from every n-th point so it costs a fraction of a cell. coarse_depth has to match the AsyncBuild's
+    inline AsyncBuild::CellBuilder pointCloudCells(const PointCloud &point_cloud, const int coarse_depth, const size_t preview_points = 1 << 18)
+    {
+        auto buckets = std::make_shared<std::vector<PointCloud>>(static_cast<size_t>(1) << 3 * coarse_depth);
+        auto preview = std::make_shared<PointCloud>();
+
+        const size_t stride = std::max<size_t>(point_cloud.size() / std::max<size_t>(preview_points, 1), 1);
+        for (size_t i = 0; i < point_cloud.size(); i++)
+        {
+            if (i % stride == 0) preview->push_back(point_cloud[i]);
+
+            uint64_t key;
+            if (!mortonQuantize(point_cloud[i].first, glm::vec3{0, 0, 0}, 0.5f, coarse_depth, key)) continue;
+            size_t cell = 0;
+            for (int level = 1; level <= coarse_depth; level++) cell = cell * 8 + mortonOctant(key, level, coarse_depth);
+            (*buckets)[cell].push_back(point_cloud[i]);
+        }
+
+        return [buckets, preview](const size_t cell, const glm::vec3 center, const float norm, const int depth, OctreeArena &arena)
+        {
+            return mortonPointCloud(cell == AsyncBuild::PREVIEW ? *preview : (*buckets)[cell], center, norm, depth, &arena);
+        };
+    }
+}
@@ -0,0 +1,326 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "generators.hpp"
+#include "voxel_linearized.hpp"
+#include "voxel_mesh.hpp"
+#include "lossy.hpp"
+#include "raycast.hpp"
+#include "async_build.hpp"
+
+// headless timings of the build, cull and linearize paths, no window or GL context is created
+// usage: voxels_bench [--json path] [--quick]
+
+namespace
+{
+    std::atomic<size_t> allocation_count = 0;
+    std::atomic<size_t> allocation_bytes = 0;
+}
+
+void *operator new(const size_t size)
+{
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void *ptr = std::malloc(size ? size : 1)) return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+namespace
+{
+    struct Measurement
+    {
+        std::string name;
+        size_t points = 0;
+        int depth = 0;
+        size_t nodes = 0;
+        unsigned threads = 1;
+        int grain_depth = 0;    // parallel builds only
+        double ns = 0;
+        size_t allocations = 0;
+        size_t allocated_bytes = 0;
+        long peak_rss_kb = 0;
+    };
+
+    std::vector<Measurement> measurements;
+
+    // Linux only: clear_refs "5" resets VmHWM so every measurement gets its own peak
+    void resetPeakRss()
+    {
+        std::ofstream("/proc/self/clear_refs") << "5";
+    }
+
+    long peakRssKb()
+    {
+        std::ifstream status("/proc/self/status");
+        for (std::string line; std::getline(status, line);)
+            if (line.rfind("VmHWM:", 0) == 0) return std::stol(line.substr(6));
+        return 0;
+    }
+
+    template<typename F>
+    auto measure(const std::string &name, const size_t points, const int depth, F &&body)
+    {
+        resetPeakRss();
+        const size_t count_before = allocation_count.load();
+        const size_t bytes_before = allocation_bytes.load();
+        const auto start = std::chrono::steady_clock::now();
+
+        auto result = body();
+
+        Measurement m{name, points, depth};
+        m.ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        m.allocations = allocation_count.load() - count_before;
+        m.allocated_bytes = allocation_bytes.load() - bytes_before;
+        m.peak_rss_kb = peakRssKb();
+        measurements.push_back(m);
+        return result;
+    }
+
+    void setNodes(const size_t nodes, const size_t last)
+    {
+        for (size_t i = measurements.size() - last; i < measurements.size(); i++)
+            measurements[i].nodes = nodes;
+    }
+
+    void setParallel(const unsigned threads, const int grain_depth)
+    {
+        measurements.back().threads = threads;
+        measurements.back().grain_depth = grain_depth;
+    }
+
+    vox::PointCloud benchPointCloud(const size_t count)
+    {
+        std::mt19937 rng(1234);
+        std::uniform_real_distribution<float> coord(-0.5f, 0.5f);
+        std::uniform_real_distribution<float> channel(0.15f, 1.f);
+
+        vox::PointCloud cloud;
+        cloud.reserve(count);
+        for (size_t i = 0; i < count; i++)
+            cloud.emplace_back(glm::vec3{coord(rng), coord(rng), coord(rng)}, glm::vec3{channel(rng), channel(rng), channel(rng)});
+        return cloud;
+    }
+
+    void benchTraversals(vox::Octree *tree, const size_t points, const int depth)
+    {
+        const size_t nodes = measure("node_count", points, depth, [&] { return static_cast<size_t>(tree->node_count()); });
+        setNodes(nodes, 1);
+
+        measure("cull", points, depth, [&] { tree->cull(); return 0; });
+        setNodes(nodes, 1);
+
+        const size_t culled = tree->node_count();
+        measure("LinVox::linearize", points, depth, [&] { return lin::LinVox(tree).get_location().size(); });
+        measure("LinearizedVoxel::linearize", points, depth, [&] { return lin::LinearizedVoxel::linearize(tree, {}).size(); });
+        measure("MeshVox::build", points, depth, [&] { return lin::MeshVox(tree, false).get_stats().triangles; });
+        measure("MeshVox::build greedy", points, depth, [&] { return lin::MeshVox(tree, true).get_stats().triangles; });
+        setNodes(culled, 4);
+
+        const lin::LinVox instances(tree);
+        const vox::Palette palette = measure("Palette", points, depth, [&] { return vox::Palette(instances.get_color()); });
+        std::vector<lin::PackedInstance> packed(instances.get_location().size());
+        measure("packInstances palette", points, depth, [&]
+        {
+            lin::packInstances(instances.get_color(), instances.get_location(), instances.get_depth(), &palette, packed);
+            return packed.size();
+        });
+        setNodes(culled, 2);
+
+        // zoomed view so both the frustum and the depth pyramid have something to reject
+        vox::Culler culler(tree);
+        glm::mat4 clip = lin::modelRotation(2.f);
+        for (int c = 0; c < 3; c++) clip[c] = clip[c] * 3.f;
+        measure("Culler::cull", points, depth, [&] { return culler.cull(clip).size(); });
+        setNodes(culled, 1);
+
+        // 2 pixel error on a 640 pixel viewport, far enough out that interior nodes get picked
+        vox::LodTree lod(tree);
+        std::vector<glm::vec3> color;
+        std::vector<uint64_t> location;
+        std::vector<int32_t> level;
+        measure("LodTree::select", points, depth, [&]
+        {
+            lod.select(lin::modelRotation(2.f), 640.f, 2.f, 0.25f, color, location, level);
+            return location.size();
+        });
+        setNodes(culled, 1);
+
+        // nodes is the ray count here, so ns/node reads as ns per ray
+        vox::Raycaster raycaster(tree);
+        vox::Framebuffer frame(256, 256);
+        measure("Raycaster::render", points, depth, [&]
+        {
+            vox::RaycastStats stats;
+            raycaster.render(lin::modelRotation(2.f), frame, &stats);
+            return stats.hits;
+        });
+        setNodes(static_cast<size_t>(frame.width) * frame.height, 1);
+
+        // last, it merges the tree in place
+        measure("lossyCull", points, depth, [&] { return vox::lossyCull(tree, 2.3f).leaves_after; });
+        setNodes(culled, 1);
+    }
+
+    std::string toJson()
+    {
+        std::ostringstream json;
+        json << "[\n";
+        for (size_t i = 0; i < measurements.size(); i++)
+        {
+            const Measurement &m = measurements[i];
+            json << "  {\"name\": \"" << m.name << "\", \"points\": " << m.points << ", \"depth\": " << m.depth
+                 << ", \"nodes\": " << m.nodes << ", \"threads\": " << m.threads << ", \"grain_depth\": " << m.grain_depth
+                 << ", \"ns\": " << static_cast<long long>(m.ns)
+                 << ", \"ns_per_node\": " << (m.nodes ? m.ns / static_cast<double>(m.nodes) : 0.0)
+                 << ", \"allocations\": " << m.allocations << ", \"allocated_bytes\": " << m.allocated_bytes
+                 << ", \"peak_rss_kb\": " << m.peak_rss_kb << "}" << (i + 1 < measurements.size() ? "," : "") << "\n";
+        }
+        json << "]\n";
+        return json.str();
+    }
+}
+
+int main(const int argc, char **argv)
+{
+    std::string json_path;
+    bool quick = false;
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--json" && i + 1 < argc) json_path = argv[++i];
+        if (arg == "--quick") quick = true;
+    }
+
+    const std::vector<size_t> point_counts = quick ? std::vector<size_t>{1000, 10000} : std::vector<size_t>{1000, 10000, 100000};
+    const std::vector<int> cloud_depths = quick ? std::vector{3, 4} : std::vector{3, 4, 5, 6};
+    const std::vector<int> volume_depths = quick ? std::vector{4, 5} : std::vector{4, 5, 6, 7, 8};
+    // doubling up to the machine's threads, which also goes in when it is not a power of two
+    const unsigned hardware_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<unsigned> thread_counts;
+    for (unsigned threads = 1; threads < hardware_threads; threads *= 2) thread_counts.push_back(threads);
+    thread_counts.push_back(hardware_threads);
+    const std::vector<int> grain_depths = quick ? std::vector{1, 2} : std::vector{1, 2, 3};
+    // genericPointCloud costs 8^depth * points, skip combinations that would run for minutes
+    const double cloud_budget = quick ? 1e7 : 3e9;
+
+    for (const size_t points : point_counts)
+    {
+        const vox::PointCloud cloud = benchPointCloud(points);
+
+        for (const int depth : cloud_depths)
+        {
+            vox::Octree *morton = measure("mortonPointCloud", points, depth, [&]
+            {
+                return vox::mortonPointCloud(cloud, glm::vec3{0, 0, 0}, 0.5, depth);
+            });
+            setNodes(morton->node_count(), 1);
+            delete morton;
+
+            if (static_cast<double>(points) * std::pow(8.0, depth) > cloud_budget) continue;
+
+            vox::Octree *tree = measure("genericPointCloud", points, depth, [&]
+            {
+                return vox::genericPointCloud(cloud, glm::vec3{0, 0, 0}, 0.5, depth);
+            });
+            setNodes(tree->node_count(), 1);
+            benchTraversals(tree, points, depth);
+            delete tree;
+        }
+    }
+
+    for (const int depth : volume_depths)
+    {
+        const auto sphere = [](const glm::vec3 c) { return glm::length(c) < 0.4f; };
+        const auto sphere_batch = [](const float *x, const float *y, const float *z, uint8_t *inside, const size_t count)
+        {
+            for (size_t i = 0; i < count; i++) inside[i] = x[i] * x[i] + y[i] * y[i] + z[i] * z[i] < 0.16f;
+        };
+
+        vox::Octree *tree = measure("genericVolume", 0, depth, [&]
+        {
+            return vox::genericVolume(std::function<bool(glm::vec3)>(sphere),
+                glm::vec3{0, 0, 0}, 0.5, depth, glm::vec3{0.8, 0.3, 0.3});
+        });
+        const size_t nodes = tree->node_count();
+        setNodes(nodes, 1);
+
+        delete measure("genericVolume inlined", 0, depth, [&]
+        {
+            return vox::genericVolume(sphere, glm::vec3{0, 0, 0}, 0.5, depth, glm::vec3{0.8, 0.3, 0.3});
+        });
+        delete measure("genericVolumeBatched", 0, depth, [&]
+        {
+            return vox::genericVolumeBatched(sphere_batch, glm::vec3{0, 0, 0}, 0.5, depth, glm::vec3{0.8, 0.3, 0.3});
+        });
+        setNodes(nodes, 2);
+
+        // pools start outside the timing, so the numbers are the build's scaling and not thread startup
+        for (const unsigned threads : thread_counts)
+        {
+            vox::ThreadPool pool(threads);
+            for (const int grain_depth : grain_depths)
+            {
+                if (grain_depth > depth) continue;
+                delete measure("genericVolumeParallel", 0, depth, [&]
+                {
+                    return vox::genericVolumeParallel(std::function<bool(glm::vec3)>(sphere),
+                        glm::vec3{0, 0, 0}, 0.5, depth, glm::vec3{0.8, 0.3, 0.3}, pool, grain_depth);
+                });
+                setNodes(nodes, 1);
+                setParallel(threads, grain_depth);
+            }
+        }
+
+        // whole build drained the way LinVox takes it in, queue hand-off included
+        measure("AsyncBuild", 0, depth, [&]
+        {
+            vox::AsyncBuild build(vox::volumeCells(sphere, glm::vec3{0.8, 0.3, 0.3}), depth);
+            size_t instances = 0;
+            vox::InstanceBatch batch;
+            while (true)
+            {
+                const bool finished = build.done();
+                if (build.poll(batch)) instances += batch.location.size();
+                else if (finished) break;
+                else std::this_thread::yield();
+            }
+            return instances;
+        });
+        setNodes(nodes, 1);
+        setParallel(hardware_threads, 2);
+        benchTraversals(tree, 0, depth);
+        delete tree;
+    }
+
+    for (const Measurement &m : measurements)
+    {
+        std::cout << m.name << " points=" << m.points << " depth=" << m.depth << " nodes=" << m.nodes
+                  << " threads=" << m.threads << " grain=" << m.grain_depth
+                  << " ms=" << m.ns / 1e6 << " ns/node=" << (m.nodes ? m.ns / static_cast<double>(m.nodes) : 0.0)
+                  << " allocs=" << m.allocations << " peak_rss_kb=" << m.peak_rss_kb << std::endl;
+    }
+
+    if (!json_path.empty()) std::ofstream(json_path) << toJson();
+}
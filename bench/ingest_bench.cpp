@@ -0,0 +1,86 @@
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cloud_io.hpp"
+#include "pcd.hpp"
+
+// writes synthetic ascii clouds of roughly the requested size and reports loader throughput per thread count
+// usage: voxels_ingest_bench [megabytes]
+
+namespace
+{
+    std::string writeCloud(const std::filesystem::path &path, const std::string &format, const size_t target_bytes)
+    {
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<float> coord(-0.5f, 0.5f);
+        std::uniform_int_distribution<int> channel(0, 255);
+
+        std::string rows;
+        rows.reserve(target_bytes + 256);
+        size_t points = 0;
+        char line[160];
+
+        while (rows.size() < target_bytes)
+        {
+            const int r = channel(rng), g = channel(rng), b = channel(rng);
+            int n;
+            if (format == "pcd")
+                n = std::snprintf(line, sizeof(line), "%.6f %.6f %.6f %u\n", coord(rng), coord(rng), coord(rng),
+                    static_cast<unsigned>(r << 16 | g << 8 | b));
+            else
+                n = std::snprintf(line, sizeof(line), "%.6f %.6f %.6f %d %d %d\n", coord(rng), coord(rng), coord(rng), r, g, b);
+            rows.append(line, n);
+            points++;
+        }
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (format == "pcd")
+            file << "VERSION 0.7\nFIELDS x y z rgb\nSIZE 4 4 4 4\nTYPE F F F U\nCOUNT 1 1 1 1\n"
+                 << "WIDTH " << points << "\nHEIGHT 1\nPOINTS " << points << "\nDATA ascii\n";
+        if (format == "ply")
+            file << "ply\nformat ascii 1.0\nelement vertex " << points << "\nproperty float x\nproperty float y\n"
+                 << "property float z\nproperty uchar red\nproperty uchar green\nproperty uchar blue\nend_header\n";
+        file << rows;
+
+        return path.string();
+    }
+}
+
+int main(const int argc, char **argv)
+{
+    const size_t megabytes = argc > 1 ? std::stoul(argv[1]) : 64;
+    const unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+    const auto dir = std::filesystem::temp_directory_path();
+
+    for (const std::string format : {"pcd", "xyz", "ply"})
+    {
+        const std::string path = writeCloud(dir / ("voxels_ingest_bench." + format), format, megabytes << 20);
+        const double mb = static_cast<double>(std::filesystem::file_size(path)) / (1 << 20);
+
+        std::vector<unsigned> thread_counts;
+        for (unsigned threads = 1; threads < hardware; threads *= 2) thread_counts.push_back(threads);
+        thread_counts.push_back(hardware);
+
+        for (const unsigned threads : thread_counts)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            vox::PointCloud cloud;
+            if (format == "pcd") cloud = vox::pcdToPointCloud(path, glm::vec3{1, 1, 1}, 1.f, threads);
+            if (format == "xyz") cloud = vox::xyzToPointCloud(path, glm::vec3{1, 1, 1}, 1.f, threads);
+            if (format == "ply") cloud = vox::plyToPointCloud(path, glm::vec3{1, 1, 1}, 1.f, threads);
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            std::cout << format << " threads=" << threads << " points=" << cloud.size()
+                      << " size=" << mb << "MB " << mb / seconds << "MB/s" << std::endl;
+        }
+
+        std::filesystem::remove(path);
+    }
+}
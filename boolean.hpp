@@ -0,0 +1,130 @@
+#pragma once
+
+#include <array>
+#include "voxel.hpp"
+#include "arena.hpp"
+
+namespace vox
+{
+    enum EBoolean
+    {
+        BOOLEAN_UNION,          // solid in either, a's color where both are
+        BOOLEAN_INTERSECTION,   // solid in both, a's color
+        BOOLEAN_DIFFERENCE,     // solid in a but not in b
+        BOOLEAN_OVERLAY         // solid in either, b's color where both are
+    };
+
+    struct BooleanStats
+    {
+        size_t visited = 0;     // node pairs walked in lockstep
+        size_t created = 0;     // interior nodes allocated for the result
+    };
+
+    // combines two trees covering the same cell. the result lives in the arena but shares every subtree
+    // the operation leaves untouched with a and b, which therefore have to outlive it and stay unedited;
+    // leaves and empties of the result are always nodes of a or b. trees may have different depths,
+    // a leaf or empty facing a subdivided node acts as eight copies of itself
+    class BooleanBuilder
+    {
+        OctreeArena &arena;
+        Octree *empty_node = nullptr;
+        BooleanStats stats;
+
+        Octree *empty_result(Octree *a, Octree *b);
+        static Octree *child(Octree *node, int i);
+
+    public:
+        explicit BooleanBuilder(OctreeArena &_arena);
+        Octree *combine(EBoolean op, Octree *a, Octree *b);
+        [[nodiscard]] const BooleanStats &get_stats() const;
+    };
+
+    inline BooleanBuilder::BooleanBuilder(OctreeArena &_arena) : arena(_arena)
+    {
+    }
+
+    inline const BooleanStats &BooleanBuilder::get_stats() const
+    {
+        return stats;
+    }
+
+    inline Octree *BooleanBuilder::child(Octree *node, const int i)
+    {
+        return node->node() ? node->get_children()[i] : node;
+    }
+
+    inline Octree *BooleanBuilder::empty_result(Octree *a, Octree *b)
+    {
+        if (a->empty()) return a;
+        if (b->empty()) return b;
+        if (!empty_node) empty_node = arena.make();
+        return empty_node;
+    }
+
+    inline Octree *BooleanBuilder::combine(const EBoolean op, Octree *a, Octree *b)
+    {
+        stats.visited++;
+
+        // cells where one side decides the whole result
+        switch (op)
+        {
+            case BOOLEAN_UNION:
+                if (a->leaf() || b->empty()) return a;
+                if (a->empty()) return b;
+                break;
+            case BOOLEAN_INTERSECTION:
+                if (a->empty() || b->empty()) return empty_result(a, b);
+                if (b->leaf()) return a;
+                break;
+            case BOOLEAN_DIFFERENCE:
+                if (a->empty() || b->leaf()) return empty_result(a, b);
+                if (b->empty()) return a;
+                break;
+            case BOOLEAN_OVERLAY:
+                if (b->leaf() || a->empty()) return b;
+                if (b->empty()) return a;
+                break;
+        }
+
+        // only here are both cells mixed, or a uniform one gets reshaped or recolored by the other's subtree
+        std::array<Octree *, 8> children{};
+        for (int i = 0; i < 8; i++) children[i] = combine(op, child(a, i), child(b, i));
+
+        // culled on the way out: uniform children fold into one of the existing nodes
+        bool empty = true, same = true, from_a = a->node(), from_b = b->node();
+        for (int i = 0; i < 8; i++)
+        {
+            empty &= children[i]->empty();
+            same &= children[i]->leaf() && children[i]->get_color() == children[0]->get_color();
+            from_a &= a->node() && children[i] == a->get_children()[i];
+            from_b &= b->node() && children[i] == b->get_children()[i];
+        }
+        if (empty) return empty_result(a, b);
+        if (same) return children[0];
+        if (from_a) return a;
+        if (from_b) return b;
+
+        stats.created++;
+        return arena.make(children);
+    }
+
+    inline Octree *unionTrees(Octree *a, Octree *b, OctreeArena &arena)
+    {
+        return BooleanBuilder(arena).combine(BOOLEAN_UNION, a, b);
+    }
+
+    inline Octree *intersectTrees(Octree *a, Octree *b, OctreeArena &arena)
+    {
+        return BooleanBuilder(arena).combine(BOOLEAN_INTERSECTION, a, b);
+    }
+
+    inline Octree *subtractTrees(Octree *a, Octree *b, OctreeArena &arena)
+    {
+        return BooleanBuilder(arena).combine(BOOLEAN_DIFFERENCE, a, b);
+    }
+
+    inline Octree *overlayTrees(Octree *a, Octree *b, OctreeArena &arena)
+    {
+        return BooleanBuilder(arena).combine(BOOLEAN_OVERLAY, a, b);
+    }
+}
@@ -0,0 +1,262 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <sys/mman.h>
+#include <glm/vec3.hpp>
+#include "pool.hpp"
+#include "mapped_file.hpp"
+
+namespace vox
+{
+    typedef std::vector<std::pair<glm::vec3, glm::vec3>> PointCloud;
+
+    // packed rgb: the 4 bytes hold 0x00RRGGBB
+    inline glm::vec3 unpackPackedColor(const uint32_t packed)
+    {
+        return glm::vec3{
+            static_cast<float>(packed >> 16 & 0xff),
+            static_cast<float>(packed >> 8 & 0xff),
+            static_cast<float>(packed & 0xff)
+        } / 255.f;
+    }
+
+    // which whitespace separated column of an ascii row holds what, -1 if absent
+    struct AsciiLayout
+    {
+        int columns = 3;
+        int x = 0, y = 1, z = 2;
+        int r = -1, g = -1, b = -1;
+        float color_scale = 1.f / 255.f;    // applied to separate r g b columns
+        int packed = -1;                    // pcd style packed rgb column
+    };
+
+    inline bool isAsciiBlank(const char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    inline float asciiFloat(const std::string_view token)
+    {
+        float value = 0;
+        std::from_chars(token.data(), token.data() + token.size(), value);
+        return value;
+    }
+
+    // serial parse of complete rows; rows with too few columns or non-finite coordinates are skipped
+    inline void parseAsciiRows(const std::string_view text, const AsciiLayout &layout, const glm::vec3 model_color, const float scale, PointCloud &ret)
+    {
+        std::vector<std::string_view> tokens(layout.columns);
+        const char *it = text.data();
+        const char *end = text.data() + text.size();
+
+        while (it < end)
+        {
+            const char *line_end = static_cast<const char *>(std::memchr(it, '\n', end - it));
+            if (!line_end) line_end = end;
+
+            int count = 0;
+            while (count < layout.columns)
+            {
+                while (it < line_end && isAsciiBlank(*it)) it++;
+                if (it == line_end) break;
+                const char *start = it;
+                while (it < line_end && !isAsciiBlank(*it)) it++;
+                tokens[count++] = {start, static_cast<size_t>(it - start)};
+            }
+            it = line_end + 1;
+            if (count < layout.columns) continue;
+
+            const glm::vec3 point{asciiFloat(tokens[layout.x]), asciiFloat(tokens[layout.y]), asciiFloat(tokens[layout.z])};
+            if (!std::isfinite(point.x) || !std::isfinite(point.y) || !std::isfinite(point.z)) continue;
+
+            glm::vec3 color = model_color;
+            if (layout.packed >= 0)
+            {
+                const std::string_view token = tokens[layout.packed];
+                // pcl writes the packed value as its uint32, other writers as the float with the same bits;
+                // only a float spelling has a point or an exponent
+                uint32_t packed = 0;
+                if (token.find_first_of(".eE") == std::string_view::npos)
+                    std::from_chars(token.data(), token.data() + token.size(), packed);
+                else
+                {
+                    const float bits = asciiFloat(token);
+                    std::memcpy(&packed, &bits, 4);
+                }
+                color = unpackPackedColor(packed);
+            }
+            else if (layout.r >= 0)
+            {
+                color = glm::vec3{asciiFloat(tokens[layout.r]), asciiFloat(tokens[layout.g]), asciiFloat(tokens[layout.b])}
+                    * layout.color_scale;
+            }
+
+            ret.emplace_back(point * scale, color);
+        }
+    }
+
+    // splits text into chunks on line boundaries, parses them on the pool and concatenates in file order
+    inline PointCloud parseAsciiParallel(const std::string_view text, const AsciiLayout &layout, const glm::vec3 model_color, const float scale, unsigned thread_count = std::thread::hardware_concurrency())
+    {
+        if (thread_count == 0) thread_count = 1;
+
+        // a few chunks per thread lets stealing even out uneven lines
+        const size_t chunk_count = std::max<size_t>(1, std::min<size_t>(thread_count * 4, text.size() / (1 << 16)));
+        std::vector<std::string_view> chunks;
+
+        size_t begin = 0;
+        for (size_t k = 1; k <= chunk_count && begin < text.size(); k++)
+        {
+            size_t split = k == chunk_count ? text.size() : std::max(begin, text.size() * k / chunk_count);
+            split = std::min(text.find('\n', split), text.size());
+            if (split < text.size()) split++;
+            chunks.push_back(text.substr(begin, split - begin));
+            begin = split;
+        }
+
+        std::vector<PointCloud> parsed(chunks.size());
+        if (chunks.size() <= 1 || thread_count == 1)
+        {
+            for (size_t k = 0; k < chunks.size(); k++)
+                parseAsciiRows(chunks[k], layout, model_color, scale, parsed[k]);
+        }
+        else
+        {
+            ThreadPool pool(thread_count);
+            for (size_t k = 0; k < chunks.size(); k++)
+                pool.submit([&, k] { parseAsciiRows(chunks[k], layout, model_color, scale, parsed[k]); });
+            pool.wait();
+        }
+
+        size_t total = 0;
+        for (const auto &cloud : parsed) total += cloud.size();
+
+        PointCloud ret{};
+        ret.reserve(total);
+        for (const auto &cloud : parsed) ret.insert(ret.end(), cloud.begin(), cloud.end());
+        return ret;
+    }
+
+    // plain "x y z" or "x y z r g b" rows, colors either 0-255 or 0-1 floats
+    inline PointCloud xyzToPointCloud(const std::string &xyz_path, glm::vec3 model_color, float scale = 1.0f, unsigned thread_count = std::thread::hardware_concurrency())
+    {
+        const MappedFile file(xyz_path);
+        file.advise(MADV_SEQUENTIAL);
+        const std::string_view text = file.text();
+
+        // first row decides the layout
+        const std::string_view first = text.substr(0, text.find('\n'));
+        std::istringstream iss{std::string(first)};
+        std::vector<std::string> tokens;
+        for (std::string token; iss >> token;) tokens.push_back(token);
+
+        AsciiLayout layout;
+        if (tokens.size() >= 6)
+        {
+            layout.columns = 6;
+            layout.r = 3;
+            layout.g = 4;
+            layout.b = 5;
+            const bool unit = std::all_of(tokens.begin() + 3, tokens.begin() + 6, [](const std::string &t)
+            {
+                return t.find('.') != std::string::npos && asciiFloat(t) <= 1.f;
+            });
+            layout.color_scale = unit ? 1.f : 1.f / 255.f;
+        }
+        else if (tokens.size() < 3) throw std::runtime_error("Xyz file rows need at least 3 columns: " + xyz_path);
+
+        return parseAsciiParallel(text, layout, model_color, scale, thread_count);
+    }
+
+    // ascii ply, only the vertex element is read
+    inline PointCloud plyToPointCloud(const std::string &ply_path, glm::vec3 model_color, float scale = 1.0f, unsigned thread_count = std::thread::hardware_concurrency())
+    {
+        const MappedFile file(ply_path);
+        file.advise(MADV_SEQUENTIAL);
+        const std::string_view text = file.text();
+
+        const size_t header_end = text.find("end_header");
+        if (text.substr(0, 3) != "ply" || header_end == std::string_view::npos)
+            throw std::runtime_error("Not a ply file: " + ply_path);
+
+        AsciiLayout layout;
+        layout.columns = 0;
+        layout.x = layout.y = layout.z = -1;
+        size_t skip_rows = 0, vertex_rows = 0;
+        bool in_vertex = false, seen_vertex = false;
+
+        std::istringstream header{std::string(text.substr(0, header_end))};
+        for (std::string line; std::getline(header, line);)
+        {
+            std::istringstream iss(line);
+            std::string key;
+            iss >> key;
+
+            if (key == "format")
+            {
+                std::string format;
+                iss >> format;
+                if (format != "ascii") throw std::runtime_error("Unsupported ply format " + format + ": " + ply_path);
+            }
+            else if (key == "element")
+            {
+                std::string name;
+                size_t count = 0;
+                iss >> name >> count;
+                in_vertex = name == "vertex";
+                if (in_vertex)
+                {
+                    vertex_rows = count;
+                    seen_vertex = true;
+                }
+                else if (!seen_vertex) skip_rows += count;
+            }
+            else if (key == "property" && in_vertex)
+            {
+                std::string type, name;
+                iss >> type >> name;
+                if (type == "list") throw std::runtime_error("Unsupported ply vertex list property: " + ply_path);
+
+                const int column = layout.columns++;
+                if (name == "x") layout.x = column;
+                if (name == "y") layout.y = column;
+                if (name == "z") layout.z = column;
+                if (name == "red" || name == "diffuse_red") layout.r = column;
+                if (name == "green" || name == "diffuse_green") layout.g = column;
+                if (name == "blue" || name == "diffuse_blue") layout.b = column;
+                if (name == "red" || name == "diffuse_red")
+                    layout.color_scale = type == "float" || type == "float32" || type == "double" ? 1.f : 1.f / 255.f;
+            }
+        }
+
+        if (layout.x < 0 || layout.y < 0 || layout.z < 0)
+            throw std::runtime_error("Ply vertex element has no x y z: " + ply_path);
+        if (layout.r < 0 || layout.g < 0 || layout.b < 0) layout.r = layout.g = layout.b = -1;
+
+        // skip to the vertex rows and cut them off before any following element
+        size_t begin = std::min(text.find('\n', header_end), text.size());
+        for (size_t i = 0; i <= skip_rows && begin < text.size(); i++)
+            begin = std::min(text.find('\n', begin), text.size()) + 1;
+        begin = std::min(begin, text.size());
+
+        size_t end = begin;
+        for (size_t i = 0; i < vertex_rows && end < text.size(); i++)
+        {
+            const void *newline = std::memchr(text.data() + end, '\n', text.size() - end);
+            end = newline ? static_cast<const char *>(newline) - text.data() + 1 : text.size();
+        }
+
+        return parseAsciiParallel(text.substr(begin, end - begin), layout, model_color, scale, thread_count);
+    }
+}
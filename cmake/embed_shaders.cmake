@@ -0,0 +1,25 @@
+# writes every shader in SHADER_DIR into OUTPUT as raw string literals, run at build time:
+# cmake -DSHADER_DIR=<dir> -DOUTPUT=<header> -P embed_shaders.cmake
+file(GLOB shaders "${SHADER_DIR}/*.vert" "${SHADER_DIR}/*.frag")
+list(SORT shaders)
+
+set(content "#pragma once\n\n// generated from shaders/ by cmake/embed_shaders.cmake, do not edit\n#include <string_view>\n\nnamespace ctx\n{\n    struct EmbeddedShader\n    {\n        std::string_view name;\n        std::string_view source;\n    };\n\n    inline constexpr EmbeddedShader EMBEDDED_SHADERS[] = {\n")
+foreach(shader IN LISTS shaders)
+    file(READ "${shader}" source)
+    get_filename_component(name "${shader}" NAME)
+    # #include "<file>" lines pull in a file next to the shader, one level deep, as shaders.hpp does when not embedding
+    string(REGEX MATCHALL "#include \"[^\"\n]+\"" includes "${source}")
+    foreach(directive IN LISTS includes)
+        string(REGEX REPLACE "#include \"([^\"\n]+)\"" "\\1" included_name "${directive}")
+        file(READ "${SHADER_DIR}/${included_name}" included)
+        string(REPLACE "${directive}" "${included}" source "${source}")
+    endforeach()
+    string(FIND "${source}" ")glsl\"" clash)
+    if(NOT clash EQUAL -1)
+        message(FATAL_ERROR "${name} contains the raw string delimiter )glsl\"")
+    endif()
+    string(APPEND content "        {\"${name}\", R\"glsl(${source})glsl\"},\n")
+endforeach()
+string(APPEND content "    };\n}\n")
+
+file(WRITE "${OUTPUT}" "${content}")
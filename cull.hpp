@@ -0,0 +1,430 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <thread>
+#include <vector>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat3x3.hpp>
+#include <glm/mat4x4.hpp>
+#include "voxel.hpp"
+#include "pool.hpp"
+
+namespace vox
+{
+    // flattened octree in the depth first leaf order LinVox instances use,
+    // so every node covers one contiguous range of instances
+    struct CullNode
+    {
+        glm::vec3 center;
+        float half;
+        uint32_t end;               // one past the last node of this subtree
+        uint32_t first_instance;
+        uint32_t instance_count;
+    };
+
+    struct InstanceRange
+    {
+        uint32_t first;
+        uint32_t count;
+    };
+
+    struct CullStats
+    {
+        size_t instances = 0;
+        size_t visible = 0;
+        size_t frustum_rejected = 0;    // nodes
+        size_t occlusion_rejected = 0;  // nodes
+        size_t occluders = 0;
+        double ms = 0;
+
+        [[nodiscard]] double culled_fraction() const
+        {
+            return instances ? 1.0 - static_cast<double>(visible) / static_cast<double>(instances) : 0.0;
+        }
+    };
+
+    // pixel rectangle [x0, x1) x [y0, y1) fully covered by something at depth z or nearer
+    struct Occluder
+    {
+        int x0, y0, x1, y1;
+        float z;
+    };
+
+    enum EFrustumTest
+    {
+        FRUSTUM_OUTSIDE,
+        FRUSTUM_INTERSECTS,
+        FRUSTUM_INSIDE
+    };
+
+    // clip planes of a model -> clip space matrix, in model space
+    struct Frustum
+    {
+        std::array<glm::vec4, 6> planes;
+
+        explicit Frustum(const glm::mat4 &clip);
+        [[nodiscard]] EFrustumTest classify(glm::vec3 center, float half) const;
+    };
+
+    inline Frustum::Frustum(const glm::mat4 &clip)
+    {
+        const auto row = [&clip](const int i) { return glm::vec4{clip[0][i], clip[1][i], clip[2][i], clip[3][i]}; };
+        for (int axis = 0; axis < 3; axis++)
+        {
+            planes[axis * 2] = row(3) + row(axis);
+            planes[axis * 2 + 1] = row(3) - row(axis);
+        }
+    }
+
+    inline EFrustumTest Frustum::classify(const glm::vec3 center, const float half) const
+    {
+        EFrustumTest ret = FRUSTUM_INSIDE;
+        for (const glm::vec4 &p : planes)
+        {
+            const float distance = p.x * center.x + p.y * center.y + p.z * center.z + p.w;
+            const float radius = half * (std::abs(p.x) + std::abs(p.y) + std::abs(p.z));
+            if (distance < -radius) return FRUSTUM_OUTSIDE;
+            if (distance < radius) ret = FRUSTUM_INTERSECTS;
+        }
+        return ret;
+    }
+
+    // coarse software depth buffer over ndc; level 0 holds occluder depths per pixel, every level
+    // above keeps the farthest of its 2x2 block so a single texel bounds a whole screen region
+    class DepthPyramid
+    {
+        int size;
+        std::vector<std::vector<float>> levels;
+
+    public:
+        explicit DepthPyramid(int _size = 128);
+        [[nodiscard]] int get_size() const;
+        void draw(const Occluder &occluder);
+        void build();
+        void clear();
+        [[nodiscard]] bool occluded(glm::vec2 lo, glm::vec2 hi, float near) const;
+    };
+
+    inline DepthPyramid::DepthPyramid(const int _size) : size(_size)
+    {
+        for (int s = size; s >= 1; s /= 2) levels.emplace_back(static_cast<size_t>(s) * s);
+        clear();
+    }
+
+    inline int DepthPyramid::get_size() const
+    {
+        return size;
+    }
+
+    inline void DepthPyramid::clear()
+    {
+        std::fill(levels[0].begin(), levels[0].end(), std::numeric_limits<float>::infinity());
+    }
+
+    inline void DepthPyramid::draw(const Occluder &occluder)
+    {
+        for (int y = occluder.y0; y < occluder.y1; y++)
+            for (int x = occluder.x0; x < occluder.x1; x++)
+            {
+                float &d = levels[0][static_cast<size_t>(y) * size + x];
+                d = std::min(d, occluder.z);
+            }
+    }
+
+    inline void DepthPyramid::build()
+    {
+        for (size_t l = 1, s = size / 2; l < levels.size(); l++, s /= 2)
+        {
+            const std::vector<float> &below = levels[l - 1];
+            for (size_t y = 0; y < s; y++)
+                for (size_t x = 0; x < s; x++)
+                {
+                    const size_t i = y * 2 * (s * 2) + x * 2;
+                    levels[l][y * s + x] = std::max({below[i], below[i + 1], below[i + s * 2], below[i + s * 2 + 1]});
+                }
+        }
+    }
+
+    // true when every pixel under the ndc rectangle already has an occluder in front of near
+    inline bool DepthPyramid::occluded(const glm::vec2 lo, const glm::vec2 hi, const float near) const
+    {
+        const float scale = static_cast<float>(size) * 0.5f;
+        int x0 = static_cast<int>(std::floor((lo.x + 1.f) * scale));
+        int y0 = static_cast<int>(std::floor((lo.y + 1.f) * scale));
+        int x1 = static_cast<int>(std::ceil((hi.x + 1.f) * scale)) - 1;
+        int y1 = static_cast<int>(std::ceil((hi.y + 1.f) * scale)) - 1;
+        x0 = std::max(x0, 0);
+        y0 = std::max(y0, 0);
+        x1 = std::min(x1, size - 1);
+        y1 = std::min(y1, size - 1);
+        if (x0 > x1 || y0 > y1) return false;
+
+        // coarsest level where the rectangle touches at most 2x2 texels
+        size_t level = 0;
+        while ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1) level++;
+
+        const int s = size >> level;
+        for (int y = y0 >> level; y <= y1 >> level; y++)
+            for (int x = x0 >> level; x <= x1 >> level; x++)
+                if (levels[level][y * s + x] >= near) return false;
+        return true;
+    }
+
+    // per frame constants for projecting node boxes
+    struct CullView
+    {
+        glm::mat4 clip;
+        Frustum frustum;
+        bool affine;                // occlusion is only tested when clip has no perspective
+        glm::mat3 extent;           // |linear part|, maps a box half size to its clip space half extents
+        float inscribed = 0;        // ndc radius of the disc inside the projection of a unit sphere
+        float depth_extent = 0;     // farthest z offset of a unit sphere
+
+        explicit CullView(const glm::mat4 &_clip);
+    };
+
+    inline CullView::CullView(const glm::mat4 &_clip) : clip(_clip), frustum(_clip)
+    {
+        affine = clip[0][3] == 0 && clip[1][3] == 0 && clip[2][3] == 0 && clip[3][3] == 1;
+        for (int c = 0; c < 3; c++)
+            for (int r = 0; r < 3; r++)
+                extent[c][r] = std::abs(clip[c][r]);
+
+        // smallest singular value of the xy rows bounds the screen footprint of any sphere
+        const glm::vec3 rx{clip[0][0], clip[1][0], clip[2][0]};
+        const glm::vec3 ry{clip[0][1], clip[1][1], clip[2][1]};
+        const float a = glm::dot(rx, rx), b = glm::dot(rx, ry), c = glm::dot(ry, ry);
+        const float lambda = (a + c) * 0.5f - std::sqrt((a - c) * (a - c) * 0.25f + b * b);
+        inscribed = std::sqrt(std::max(lambda, 0.f));
+        depth_extent = glm::length(glm::vec3{clip[0][2], clip[1][2], clip[2][2]});
+    }
+
+    // frustum and hierarchical z culling of a flattened octree, producing compacted instance ranges
+    class Culler
+    {
+        struct Task
+        {
+            uint32_t root = 0;
+            bool inside = false;
+            std::vector<Occluder> occluders{};
+            std::vector<InstanceRange> ranges{};
+            CullStats stats{};
+        };
+
+        std::vector<CullNode> nodes;
+        std::vector<Task> tasks;
+        std::vector<InstanceRange> ranges;
+        DepthPyramid pyramid;
+        ThreadPool pool;
+        int grain_depth;
+
+        void flatten(const Octree *node, glm::vec3 center, float half, uint32_t &instance);
+        void split(uint32_t index, int depth, const CullView &view, bool inside, CullStats &stats);
+        void rasterize(uint32_t index, const CullView &view, bool inside, Task &task) const;
+        void traverse(uint32_t index, const CullView &view, bool inside, Task &task) const;
+
+    public:
+        explicit Culler(const Octree *tree, unsigned thread_count = std::thread::hardware_concurrency(), int _grain_depth = 2, int pyramid_size = 128);
+        const std::vector<InstanceRange> &cull(const glm::mat4 &clip, CullStats *stats = nullptr);
+        [[nodiscard]] size_t instance_count() const;
+        [[nodiscard]] const std::vector<CullNode> &get_nodes() const;
+    };
+
+    inline Culler::Culler(const Octree *tree, const unsigned thread_count, const int _grain_depth, const int pyramid_size)
+        : pyramid(pyramid_size), pool(std::max(thread_count, 1u)), grain_depth(_grain_depth)
+    {
+        uint32_t instance = 0;
+        flatten(tree, glm::vec3{0, 0, 0}, 0.5f, instance);
+    }
+
+    inline void Culler::flatten(const Octree *node, const glm::vec3 center, const float half, uint32_t &instance)
+    {
+        if (node->empty()) return;
+
+        const auto index = static_cast<uint32_t>(nodes.size());
+        nodes.push_back({center, half, 0, instance, 0});
+        if (node->leaf()) instance++;
+        else for (int i = 0; i < 8; i++)
+            flatten(node->get_children()[i], center + DCENTERS[i] * (half * 0.5f), half * 0.5f, instance);
+
+        // uncollapsed nodes with only empty children would otherwise look like leaves
+        if (instance == nodes[index].first_instance)
+        {
+            nodes.resize(index);
+            return;
+        }
+
+        nodes[index].end = static_cast<uint32_t>(nodes.size());
+        nodes[index].instance_count = instance - nodes[index].first_instance;
+    }
+
+    inline size_t Culler::instance_count() const
+    {
+        return nodes.empty() ? 0 : nodes[0].instance_count;
+    }
+
+    inline const std::vector<CullNode> &Culler::get_nodes() const
+    {
+        return nodes;
+    }
+
+    // frustum tests the top levels serially and hands every surviving subtree at grain_depth to a task
+    inline void Culler::split(const uint32_t index, const int depth, const CullView &view, bool inside, CullStats &stats)
+    {
+        const CullNode &node = nodes[index];
+        if (!inside)
+        {
+            const EFrustumTest test = view.frustum.classify(node.center, node.half);
+            if (test == FRUSTUM_OUTSIDE)
+            {
+                stats.frustum_rejected++;
+                return;
+            }
+            inside = test == FRUSTUM_INSIDE;
+        }
+
+        if (depth == grain_depth || node.end == index + 1)
+        {
+            tasks.push_back({index, inside});
+            return;
+        }
+
+        for (uint32_t child = index + 1; child < node.end; child = nodes[child].end)
+            split(child, depth + 1, view, inside, stats);
+    }
+
+    // leaves inside the frustum occlude the square inscribed in their sphere's footprint up to the sphere's
+    // farthest depth; everything behind that inside the square is hidden by the solid cube
+    inline void Culler::rasterize(const uint32_t index, const CullView &view, bool inside, Task &task) const
+    {
+        const CullNode &node = nodes[index];
+        if (!inside)
+        {
+            const EFrustumTest test = view.frustum.classify(node.center, node.half);
+            if (test == FRUSTUM_OUTSIDE) return;
+            inside = test == FRUSTUM_INSIDE;
+        }
+
+        const int size = pyramid.get_size();
+        const float scale = static_cast<float>(size) * 0.5f;
+        const float square = view.inscribed * node.half * 0.70710678f * scale;
+        // nothing below this node can cover a whole pixel
+        if (square * 2.f < 1.f) return;
+
+        if (node.end != index + 1)
+        {
+            for (uint32_t child = index + 1; child < node.end; child = nodes[child].end)
+                rasterize(child, view, inside, task);
+            return;
+        }
+
+        const glm::vec4 c = view.clip * glm::vec4(node.center, 1.f);
+        const float cx = (c.x + 1.f) * scale, cy = (c.y + 1.f) * scale;
+        const int x0 = std::max(static_cast<int>(std::ceil(cx - square)), 0);
+        const int y0 = std::max(static_cast<int>(std::ceil(cy - square)), 0);
+        const int x1 = std::min(static_cast<int>(std::floor(cx + square)), size);
+        const int y1 = std::min(static_cast<int>(std::floor(cy + square)), size);
+        if (x0 >= x1 || y0 >= y1) return;
+
+        task.occluders.push_back({x0, y0, x1, y1, c.z + view.depth_extent * node.half});
+    }
+
+    inline void Culler::traverse(const uint32_t index, const CullView &view, bool inside, Task &task) const
+    {
+        const CullNode &node = nodes[index];
+        if (!inside)
+        {
+            const EFrustumTest test = view.frustum.classify(node.center, node.half);
+            if (test == FRUSTUM_OUTSIDE)
+            {
+                task.stats.frustum_rejected++;
+                return;
+            }
+            inside = test == FRUSTUM_INSIDE;
+        }
+
+        bool single_pixel = false;
+        if (view.affine)
+        {
+            const glm::vec4 c = view.clip * glm::vec4(node.center, 1.f);
+            const glm::vec3 e = view.extent * glm::vec3(node.half);
+            const glm::vec2 lo{c.x - e.x, c.y - e.y}, hi{c.x + e.x, c.y + e.y};
+            if (pyramid.occluded(lo, hi, c.z - e.z))
+            {
+                task.stats.occlusion_rejected++;
+                return;
+            }
+            single_pixel = (hi.x - lo.x) * static_cast<float>(pyramid.get_size()) * 0.5f <= 1.f
+                && (hi.y - lo.y) * static_cast<float>(pyramid.get_size()) * 0.5f <= 1.f;
+        }
+
+        // leaves, and whole subtrees that the depth buffer could not tell apart anymore
+        if (node.end == index + 1 || (inside && single_pixel))
+        {
+            std::vector<InstanceRange> &out = task.ranges;
+            if (!out.empty() && out.back().first + out.back().count == node.first_instance)
+                out.back().count += node.instance_count;
+            else out.push_back({node.first_instance, node.instance_count});
+            return;
+        }
+
+        for (uint32_t child = index + 1; child < node.end; child = nodes[child].end)
+            traverse(child, view, inside, task);
+    }
+
+    // returns the visible instance ranges in instance order, adjacent ranges merged
+    inline const std::vector<InstanceRange> &Culler::cull(const glm::mat4 &clip, CullStats *stats)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        const CullView view(clip);
+
+        CullStats total{};
+        total.instances = instance_count();
+        tasks.clear();
+        ranges.clear();
+        if (!nodes.empty()) split(0, 0, view, false, total);
+
+        // occluders are collected in parallel and drawn in one go, then the hierarchical test runs over the pyramid
+        pyramid.clear();
+        if (view.affine)
+        {
+            for (Task &task : tasks)
+                pool.submit([this, &task, &view] { rasterize(task.root, view, task.inside, task); });
+            pool.wait();
+            for (const Task &task : tasks)
+            {
+                for (const Occluder &occluder : task.occluders) pyramid.draw(occluder);
+                total.occluders += task.occluders.size();
+            }
+            pyramid.build();
+        }
+
+        for (Task &task : tasks)
+            pool.submit([this, &task, &view] { traverse(task.root, view, task.inside, task); });
+        pool.wait();
+
+        for (const Task &task : tasks)
+        {
+            for (const InstanceRange &range : task.ranges)
+            {
+                if (!ranges.empty() && ranges.back().first + ranges.back().count == range.first)
+                    ranges.back().count += range.count;
+                else ranges.push_back(range);
+                total.visible += range.count;
+            }
+            total.frustum_rejected += task.stats.frustum_rejected;
+            total.occlusion_rejected += task.stats.occlusion_rejected;
+        }
+
+        total.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (stats) *stats = total;
+        return ranges;
+    }
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <glm/vec3.hpp>
+#include "voxel.hpp"
+#include "arena.hpp"
+
+namespace vox
+{
+    struct DagStats
+    {
+        size_t tree_nodes = 0;
+        size_t tree_bytes = 0;
+        size_t dag_nodes = 0;
+        size_t dag_bytes = 0;
+    };
+
+    // canonical identity of a node once its children are already shared
+    struct DagKey
+    {
+        EOctant octant;
+        std::array<uint32_t, 3> color;
+        std::array<Octree *, 8> children;
+
+        bool operator==(const DagKey &) const = default;
+    };
+
+    struct DagKeyHash
+    {
+        size_t operator()(const DagKey &key) const
+        {
+            size_t hash = key.octant;
+            const auto mix = [&hash](const size_t value)
+            {
+                hash ^= value + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+            };
+
+            for (const uint32_t c : key.color) mix(c);
+            for (const Octree *child : key.children) mix(std::hash<const Octree *>{}(child));
+            return hash;
+        }
+    };
+
+    class DagBuilder
+    {
+        OctreeArena &arena;
+        std::unordered_map<DagKey, Octree *, DagKeyHash> shared;
+
+        Octree *intern(const DagKey &key, glm::vec3 color);
+
+    public:
+        explicit DagBuilder(OctreeArena &_arena);
+        Octree *compact(const Octree *node);
+        [[nodiscard]] size_t size() const;
+    };
+
+    inline DagBuilder::DagBuilder(OctreeArena &_arena) : arena(_arena)
+    {
+    }
+
+    inline Octree *DagBuilder::intern(const DagKey &key, const glm::vec3 color)
+    {
+        const auto found = shared.find(key);
+        if (found != shared.end()) return found->second;
+
+        Octree *node;
+        switch (key.octant)
+        {
+            case OCTANT_LEAF:
+                node = arena.make(color);
+                break;
+            case OCTANT_EMPTY:
+                node = arena.make();
+                break;
+            default:
+                node = arena.make(key.children);
+                break;
+        }
+
+        shared.emplace(key, node);
+        return node;
+    }
+
+    inline Octree *DagBuilder::compact(const Octree *node)
+    {
+        DagKey key{};
+        key.octant = node->node() ? OCTANT_NODE : node->leaf() ? OCTANT_LEAF : OCTANT_EMPTY;
+
+        if (node->leaf())
+        {
+            const glm::vec3 color = node->get_color();
+            key.color = {std::bit_cast<uint32_t>(color.r), std::bit_cast<uint32_t>(color.g), std::bit_cast<uint32_t>(color.b)};
+            return intern(key, color);
+        }
+        if (node->empty()) return intern(key, {});
+
+        const auto children = node->get_children();
+        for (int i = 0; i < 8; i++) key.children[i] = compact(children[i]);
+
+        // eight identical leaves or empties collapse, same as Octree::cull
+        bool uniform = !key.children[0]->node();
+        for (int i = 1; i < 8 && uniform; i++) uniform = key.children[i] == key.children[0];
+        if (uniform) return key.children[0];
+
+        return intern(key, {});
+    }
+
+    inline size_t DagBuilder::size() const
+    {
+        return shared.size();
+    }
+
+    // number of distinct nodes reachable from root
+    inline size_t uniqueNodeCount(const Octree *root)
+    {
+        std::unordered_set<const Octree *> seen;
+        std::vector<const Octree *> stack{root};
+
+        while (!stack.empty())
+        {
+            const Octree *node = stack.back();
+            stack.pop_back();
+            if (!seen.insert(node).second || !node->node()) continue;
+
+            for (const Octree *child : node->get_children()) stack.push_back(child);
+        }
+
+        return seen.size();
+    }
+
+    // hashes subtrees bottom-up and shares identical ones; the result is a culled Octree whose nodes
+    // may have several parents, so it must only ever be freed through its arena. Voxel and LinVox
+    // draw it unchanged.
+    inline Octree *dagCompact(const Octree *tree, OctreeArena &arena, DagStats *stats = nullptr)
+    {
+        DagBuilder builder(arena);
+        Octree *root = builder.compact(tree);
+
+        if (stats)
+        {
+            stats->tree_nodes = uniqueNodeCount(tree);
+            stats->tree_bytes = stats->tree_nodes * sizeof(Octree);
+            stats->dag_nodes = uniqueNodeCount(root);
+            stats->dag_bytes = stats->dag_nodes * sizeof(Octree);
+        }
+
+        return root;
+    }
+}
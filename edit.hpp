@@ -0,0 +1,131 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include <glm/vec3.hpp>
+#include "voxel.hpp"
+#include "morton.hpp"
+#include "arena.hpp"
+
+namespace vox
+{
+    enum EEdit
+    {
+        EDIT_SET,       // fill the cell with color
+        EDIT_CLEAR,     // empty the cell
+        EDIT_PAINT      // recolor whatever is solid inside the cell
+    };
+
+    // subtree whose leaves an edit replaced, addressed like LinVox locations:
+    // octant path in base 8 digits, level 1 in the lowest digit
+    struct EditRegion
+    {
+        const Octree *node = nullptr;   // nullptr when the edit changed nothing
+        int depth = 0;
+        uint64_t path = 0;
+    };
+
+    // splits a leaf or empty into eight copies of itself, reusing children kept from an earlier collapse
+    inline void subdivide(Octree *node, OctreeArena *arena)
+    {
+        const bool leaf = node->leaf();
+        const glm::vec3 color = node->get_color();
+        const auto children = node->get_children();
+
+        for (int i = 0; i < 8; i++)
+        {
+            if (!children[i]) node->set_child(i, leaf ? allocOctree(arena, color) : allocOctree(arena));
+            else if (leaf) children[i]->make_leaf(color);
+            else children[i]->make_empty();
+        }
+        node->make_node();
+    }
+
+    inline bool paintSubtree(Octree *node, const glm::vec3 color)
+    {
+        if (node->empty()) return false;
+        if (node->leaf())
+        {
+            if (node->get_color() == color) return false;
+            node->make_leaf(color);
+            return true;
+        }
+
+        bool changed = false;
+        for (Octree *child : node->get_children()) changed |= paintSubtree(child, color);
+        return changed;
+    }
+
+    // edits the cell of the given depth containing point and re-culls only the ancestors on its path.
+    // the tree must not share nodes (no dagCompact result); nodes it has to add come from arena when given
+    inline EditRegion editVoxel(Octree *root, const EEdit op, const glm::vec3 point, const glm::vec3 center, const float norm,
+                                const int depth, const glm::vec3 color = {}, OctreeArena *arena = nullptr)
+    {
+        uint64_t key;
+        if (depth > MORTON_MAX_DEPTH || !mortonQuantize(point, center, norm, depth, key)) return {};
+
+        std::vector<Octree *> path{root};
+        std::vector<uint64_t> locations{0};
+        int region = depth;
+        Octree *node = root;
+
+        for (int level = 1; level <= depth; level++)
+        {
+            if (!node->node())
+            {
+                // nothing to do inside a uniform cell that already looks like the result
+                if (node->empty() && op != EDIT_SET) return {};
+                if (node->leaf() && op != EDIT_CLEAR && node->get_color() == color) return {};
+
+                subdivide(node, arena);
+                region = std::min(region, level - 1);
+            }
+
+            const int octant = MORTON_OCTANTS[key >> 3 * (depth - level) & 7];
+            locations.push_back(locations.back() + (static_cast<uint64_t>(octant) << 3 * (level - 1)));
+            node = node->get_children()[octant];
+            path.push_back(node);
+        }
+
+        switch (op)
+        {
+            case EDIT_SET:
+                if (node->leaf() && node->get_color() == color) return {};
+                node->make_leaf(color);
+                break;
+            case EDIT_CLEAR:
+                if (node->empty()) return {};
+                node->make_empty();
+                break;
+            case EDIT_PAINT:
+                if (!paintSubtree(node, color)) return {};
+                node->cull();
+                break;
+        }
+
+        // a node that did not collapse keeps every ancestor from collapsing too
+        for (int level = depth - 1; level >= 0 && path[level]->collapse(); level--)
+            region = std::min(region, level);
+
+        return {path[region], region, locations[region]};
+    }
+
+    inline EditRegion setVoxel(Octree *root, const glm::vec3 point, const glm::vec3 center, const float norm, const int depth,
+                               const glm::vec3 color, OctreeArena *arena = nullptr)
+    {
+        return editVoxel(root, EDIT_SET, point, center, norm, depth, color, arena);
+    }
+
+    inline EditRegion clearVoxel(Octree *root, const glm::vec3 point, const glm::vec3 center, const float norm, const int depth,
+                                 OctreeArena *arena = nullptr)
+    {
+        return editVoxel(root, EDIT_CLEAR, point, center, norm, depth, {}, arena);
+    }
+
+    inline EditRegion paintVoxel(Octree *root, const glm::vec3 point, const glm::vec3 center, const float norm, const int depth,
+                                 const glm::vec3 color, OctreeArena *arena = nullptr)
+    {
+        return editVoxel(root, EDIT_PAINT, point, center, norm, depth, color, arena);
+    }
+}
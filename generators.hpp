@@ -3,18 +3,44 @@
 #include <functional>
 #include <fstream>
 #include <array>
+#include <algorithm>
+#include <mutex>
+#include <type_traits>
+#include <vector>
 #include "voxel.hpp"
+#include "morton.hpp"
+#include "norm.hpp"
+#include "pool.hpp"
+#include "arena.hpp"
+#include "pcd.hpp"
 #include <cstdlib>
 #include <ctime>
 
 namespace vox
 {
-    typedef std::vector<std::pair<glm::vec3, glm::vec3>> PointCloud;
+    inline Octree *genericVolume(const std::function<bool(glm::vec3)> &enclosed, glm::vec3 center, float norm, int max_depth, glm::vec3 color, OctreeArena *arena = nullptr)
+    {
+        if (enclosed(center) && max_depth == 0) return allocOctree(arena, color);
+        if (max_depth == 0) return allocOctree(arena);
+
+        std::array<Octree *, 8> children{};
+
+        for (int i = 0; i < 8; i++)
+        {
+            children[i] = genericVolume(enclosed,
+                DCENTERS[i] * norm * 0.5f + center,
+                norm * 0.5, max_depth - 1, color, arena
+            );
+        }
 
-    inline Octree *genericVolume(std::function<bool(glm::vec3)> enclosed, glm::vec3 center, float norm, int max_depth, glm::vec3 color)
+        return allocOctree(arena, children);
+    }
+
+    // same tree as above, but the predicate type is known so its call can be inlined
+    template<typename F> requires std::is_invocable_r_v<bool, const F &, glm::vec3>
+    inline Octree *genericVolume(const F &enclosed, glm::vec3 center, float norm, int max_depth, glm::vec3 color, OctreeArena *arena = nullptr)
     {
-        if (enclosed(center) && max_depth == 0) return new Octree(color);
-        if (max_depth == 0) return new Octree();
+        if (max_depth == 0) return enclosed(center) ? allocOctree(arena, color) : allocOctree(arena);
 
         std::array<Octree *, 8> children{};
 
@@ -22,14 +48,225 @@ namespace vox
         {
             children[i] = genericVolume(enclosed,
                 DCENTERS[i] * norm * 0.5f + center,
-                norm * 0.5, max_depth - 1, color
+                norm * 0.5, max_depth - 1, color, arena
             );
         }
 
-        return new Octree(children);
+        return allocOctree(arena, children);
     }
 
-    inline Octree *genericPointCloud(PointCloud point_cloud, glm::vec3 center, float norm, int max_depth)
+    // sample points in SoA form; a batched predicate reads count points from x, y, z and writes
+    // inside[i] = 1 for every enclosed one, plain loops over the arrays vectorise
+    struct SampleBlock
+    {
+        std::vector<float> x, y, z;
+        std::vector<uint8_t> inside;
+
+        void clear()
+        {
+            x.clear();
+            y.clear();
+            z.clear();
+        }
+
+        void push(const glm::vec3 p)
+        {
+            x.push_back(p.x);
+            y.push_back(p.y);
+            z.push_back(p.z);
+        }
+
+        [[nodiscard]] size_t size() const
+        {
+            return x.size();
+        }
+    };
+
+    template<typename F>
+    concept BatchVolumePredicate = std::is_invocable_v<const F &, const float *, const float *, const float *, uint8_t *, size_t>;
+
+    // wraps a per point predicate for the batched builder
+    template<typename F>
+    auto batchPredicate(F enclosed)
+    {
+        return [enclosed](const float *x, const float *y, const float *z, uint8_t *inside, const size_t count)
+        {
+            for (size_t i = 0; i < count; i++) inside[i] = enclosed(glm::vec3{x[i], y[i], z[i]});
+        };
+    }
+
+    // leaf centers of a depth levels deep subtree, in the order genericVolume visits them
+    inline void gatherSamples(const glm::vec3 center, const float norm, const int depth, SampleBlock &block)
+    {
+        if (depth == 0)
+        {
+            block.push(center);
+            return;
+        }
+
+        for (int i = 0; i < 8; i++) gatherSamples(DCENTERS[i] * norm * 0.5f + center, norm * 0.5, depth - 1, block);
+    }
+
+    inline Octree *assembleSamples(const uint8_t *&inside, const int depth, const glm::vec3 color, OctreeArena *arena)
+    {
+        if (depth == 0) return *inside++ ? allocOctree(arena, color) : allocOctree(arena);
+
+        std::array<Octree *, 8> children{};
+        for (int i = 0; i < 8; i++) children[i] = assembleSamples(inside, depth - 1, color, arena);
+        return allocOctree(arena, children);
+    }
+
+    template<BatchVolumePredicate F>
+    inline Octree *batchedVolume(const F &enclosed, glm::vec3 center, float norm, int max_depth, glm::vec3 color, int brick_depth, SampleBlock &block, OctreeArena *arena)
+    {
+        if (max_depth <= brick_depth)
+        {
+            block.clear();
+            gatherSamples(center, norm, max_depth, block);
+            block.inside.resize(block.size());
+            enclosed(block.x.data(), block.y.data(), block.z.data(), block.inside.data(), block.size());
+
+            const uint8_t *inside = block.inside.data();
+            return assembleSamples(inside, max_depth, color, arena);
+        }
+
+        std::array<Octree *, 8> children{};
+        for (int i = 0; i < 8; i++)
+        {
+            children[i] = batchedVolume(enclosed,
+                DCENTERS[i] * norm * 0.5f + center,
+                norm * 0.5, max_depth - 1, color, brick_depth, block, arena
+            );
+        }
+
+        return allocOctree(arena, children);
+    }
+
+    // same tree as genericVolume, the predicate sees whole bricks of 8^brick_depth samples per call
+    // (brick_depth 1 are the 8 children of a cell, 2 a 4^3 brick, ...)
+    template<BatchVolumePredicate F>
+    inline Octree *genericVolumeBatched(const F &enclosed, glm::vec3 center, float norm, int max_depth, glm::vec3 color, OctreeArena *arena = nullptr, int brick_depth = 2)
+    {
+        SampleBlock block;
+        return batchedVolume(enclosed, center, norm, max_depth, color, std::max(brick_depth, 0), block, arena);
+    }
+
+    // classifies a whole cell (center, norm): OCTANT_LEAF if provably inside,
+    // OCTANT_EMPTY if provably outside, OCTANT_NODE if unknown
+    typedef std::function<EOctant(glm::vec3, float)> VolumeBound;
+
+    struct PrunedOctant
+    {
+        EOctant octant;
+        Octree *node;
+    };
+
+    inline Octree *materializePruned(const PrunedOctant &pruned, glm::vec3 color, OctreeArena *arena)
+    {
+        switch (pruned.octant)
+        {
+            case OCTANT_LEAF:
+                return allocOctree(arena, color);
+            case OCTANT_EMPTY:
+                return allocOctree(arena);
+            default:
+                return pruned.node;
+        }
+    }
+
+    inline PrunedOctant prunedVolume(const std::function<bool(glm::vec3)> &enclosed, const VolumeBound &bound, glm::vec3 center, float norm, int max_depth, glm::vec3 color, OctreeArena *arena)
+    {
+        if (max_depth == 0) return {enclosed(center) ? OCTANT_LEAF : OCTANT_EMPTY, nullptr};
+
+        if (bound)
+        {
+            const EOctant bounded = bound(center, norm);
+            if (bounded != OCTANT_NODE) return {bounded, nullptr};
+        }
+
+        std::array<PrunedOctant, 8> pruned{};
+        for (int i = 0; i < 8; i++)
+        {
+            pruned[i] = prunedVolume(enclosed, bound,
+                DCENTERS[i] * norm * 0.5f + center,
+                norm * 0.5f, max_depth - 1, color, arena
+            );
+        }
+
+        // uniform children never get allocated
+        bool uniform = pruned[0].octant != OCTANT_NODE;
+        for (int i = 1; i < 8 && uniform; i++)
+            uniform = pruned[i].octant == pruned[0].octant;
+        if (uniform) return {pruned[0].octant, nullptr};
+
+        std::array<Octree *, 8> children{};
+        for (int i = 0; i < 8; i++) children[i] = materializePruned(pruned[i], color, arena);
+
+        return {OCTANT_NODE, allocOctree(arena, children)};
+    }
+
+    // builds the already culled tree, merging uniform children while unwinding so that only
+    // nodes on the surface are ever allocated; the optional bound skips provably uniform cells
+    inline Octree *genericVolumePruned(const std::function<bool(glm::vec3)> &enclosed, glm::vec3 center, float norm, int max_depth, glm::vec3 color, const VolumeBound &bound = nullptr, OctreeArena *arena = nullptr)
+    {
+        return materializePruned(
+            prunedVolume(enclosed, bound, center, norm, max_depth, color, arena),
+            color, arena
+        );
+    }
+
+    // splits the tree at grain_depth into 8^grain_depth serial subtree builds spread over the pool,
+    // yields the same tree as genericVolume; enclosed gets called concurrently and must be thread-safe
+    inline Octree *genericVolumeParallel(const std::function<bool(glm::vec3)> &enclosed, glm::vec3 center, float norm, int max_depth, glm::vec3 color, ThreadPool &pool, int grain_depth = 2, OctreeArena *arena = nullptr)
+    {
+        grain_depth = std::clamp(grain_depth, 0, max_depth);
+
+        std::vector<Octree *> subtrees(static_cast<size_t>(1) << 3 * grain_depth);
+
+        // subtrees fill private arenas which get merged into the shared one
+        std::mutex arena_mutex;
+
+        std::function<void(size_t, int, glm::vec3, float)> split;
+        split = [&](const size_t index, const int depth, const glm::vec3 c, const float n)
+        {
+            if (depth == grain_depth)
+            {
+                if (!arena)
+                {
+                    subtrees[index] = genericVolume(enclosed, c, n, max_depth - depth, color);
+                    return;
+                }
+
+                OctreeArena local;
+                subtrees[index] = genericVolume(enclosed, c, n, max_depth - depth, color, &local);
+                std::lock_guard lock(arena_mutex);
+                arena->adopt(std::move(local));
+                return;
+            }
+
+            for (int i = 0; i < 8; i++)
+            {
+                const glm::vec3 child_center = DCENTERS[i] * n * 0.5f + c;
+                pool.submit([&split, index, i, depth, child_center, n]
+                {
+                    split(index * 8 + i, depth + 1, child_center, n * 0.5f);
+                });
+            }
+        };
+
+        split(0, 0, center, norm);
+        pool.wait();
+
+        return foldSubtrees(std::move(subtrees), arena);
+    }
+
+    inline Octree *genericVolumeParallel(const std::function<bool(glm::vec3)> &enclosed, glm::vec3 center, float norm, int max_depth, glm::vec3 color, unsigned thread_count, int grain_depth = 2, OctreeArena *arena = nullptr)
+    {
+        ThreadPool pool(thread_count);
+        return genericVolumeParallel(enclosed, center, norm, max_depth, color, pool, grain_depth, arena);
+    }
+
+    inline Octree *genericPointCloud(const PointCloud &point_cloud, glm::vec3 center, float norm, int max_depth, OctreeArena *arena = nullptr)
     {
         if (max_depth == 0)
         {
@@ -43,8 +280,8 @@ namespace vox
                     color += col;
                 }
 
-            if (enclosed_count == 0) return new Octree();
-            return new Octree(1.0f / static_cast<float>(enclosed_count) * color);
+            if (enclosed_count == 0) return allocOctree(arena);
+            return allocOctree(arena, 1.0f / static_cast<float>(enclosed_count) * color);
         }
 
         std::array<Octree *, 8> children{};
@@ -53,65 +290,89 @@ namespace vox
         {
             children[i] = genericPointCloud(
                 point_cloud, DCENTERS[i] * norm * 0.5f + center,
-                norm * 0.5f, max_depth - 1
+                norm * 0.5f, max_depth - 1, arena
             );
         }
 
-        return new Octree(children);
+        return allocOctree(arena, children);
     }
 
-    PointCloud randomPointCloud(int count)
+    // quantizes every point once, radix sorts the morton keys and assembles the tree bottom-up
+    inline Octree *mortonPointCloud(const PointCloud &point_cloud, glm::vec3 center, float norm, int max_depth, OctreeArena *arena = nullptr)
     {
-        std::srand(std::time(nullptr));
+        if (max_depth > MORTON_MAX_DEPTH)
+            throw std::runtime_error("Point cloud depth exceeds morton key range.");
 
-        PointCloud ret{{}};
-        for (int i = 0; i < count; i++)
+        std::vector<MortonEntry> entries;
+        entries.reserve(point_cloud.size());
+        for (uint32_t i = 0; i < point_cloud.size(); i++)
         {
-            ret.emplace_back(
-                glm::vec3{(std::rand() % 1000 - 500) / 1000.f,
-                            (std::rand() % 1000 - 500) / 1000.f,
-                            (std::rand() % 1000 - 500) / 1000.f},
-                glm::vec3{(std::rand() % 220 + 35) / 255.f,
-                            (std::rand() % 220 + 35) / 255.f,
-                            (std::rand() % 220 + 35) / 255.f}
-            );
+            uint64_t key;
+            if (mortonQuantize(point_cloud[i].first, center, norm, max_depth, key))
+                entries.push_back({key, i});
         }
 
-        return ret;
-    }
+        if (entries.empty()) return allocOctree(arena);
 
-    PointCloud pcdToPointCloud(const std::string& pcd_path, glm::vec3 model_color, float scale = 1.0f)
-    {
-        std::ifstream pcd_file;
-        pcd_file.open(pcd_path);
+        radixSort(entries, 3 * max_depth);
+
+        // average colors of points sharing a leaf
+        std::vector<std::pair<uint64_t, Octree *>> level{};
+        for (size_t i = 0; i < entries.size();)
+        {
+            const uint64_t key = entries[i].key;
+            glm::vec3 color{0, 0, 0};
+            int enclosed_count = 0;
+
+            for (; i < entries.size() && entries[i].key == key; i++)
+            {
+                color += point_cloud[entries[i].index].second;
+                enclosed_count++;
+            }
+
+            level.emplace_back(key, allocOctree(arena, 1.0f / static_cast<float>(enclosed_count) * color));
+        }
 
-        std::string line;
-        while (std::getline(pcd_file, line))
+        // keys stay sorted, so siblings are always adjacent
+        for (int d = max_depth; d > 0; d--)
         {
-            std::istringstream iss(line);
-            std::string key, value;
-            if (!(iss >> key >> value)) throw std::runtime_error("Fuck");
-            std::cout << key << value << std::endl;
-            if (key == "DATA")
+            std::vector<std::pair<uint64_t, Octree *>> parents{};
+            for (size_t i = 0; i < level.size();)
             {
-                if (value == "ascii") break;
-                throw std::runtime_error("Unsupported pcd format error.");
+                const uint64_t parent = level[i].first >> 3;
+                std::array<Octree *, 8> children{};
+
+                for (; i < level.size() && level[i].first >> 3 == parent; i++)
+                    children[MORTON_OCTANTS[level[i].first & 7]] = level[i].second;
+
+                for (auto &child : children)
+                    if (child == nullptr) child = allocOctree(arena);
+
+                parents.emplace_back(parent, allocOctree(arena, children));
             }
+            level.swap(parents);
         }
 
+        return level[0].second;
+    }
+
+    PointCloud randomPointCloud(int count)
+    {
+        std::srand(std::time(nullptr));
+
         PointCloud ret{{}};
-        float x, y, z;
-        while (pcd_file >> x >> y >> z)
+        for (int i = 0; i < count; i++)
         {
-            std::cout << x << y << z << std::endl;
             ret.emplace_back(
-                glm::vec3{x, y, z} * scale,
-                model_color
+                glm::vec3{(std::rand() % 1000 - 500) / 1000.f,
+                            (std::rand() % 1000 - 500) / 1000.f,
+                            (std::rand() % 1000 - 500) / 1000.f},
+                glm::vec3{(std::rand() % 220 + 35) / 255.f,
+                            (std::rand() % 220 + 35) / 255.f,
+                            (std::rand() % 220 + 35) / 255.f}
             );
         }
 
-        pcd_file.close();
-
         return ret;
     }
 
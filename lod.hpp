@@ -0,0 +1,175 @@
+#pragma once
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+#include "voxel.hpp"
+
+namespace vox
+{
+    // depth first copy of an octree where interior nodes carry the filtered color and the solid
+    // fraction of their volume, so any of them can stand in for its subtree
+    struct LodNode
+    {
+        glm::vec3 color;
+        float occupancy;
+        uint32_t end;           // one past the last node of this subtree
+        uint8_t octant;         // index in the parent, DCENTERS order
+    };
+
+    struct LodStats
+    {
+        size_t selected = 0;
+        size_t coarse = 0;      // interior nodes drawn in place of their subtree
+        double ms = 0;
+    };
+
+    class LodTree
+    {
+        std::vector<LodNode> nodes;
+        std::vector<uint8_t> refined;   // last decision per node, for hysteresis
+
+        float flatten(const Octree *node, uint8_t octant);
+
+    public:
+        explicit LodTree(const Octree *tree);
+
+        // walks down until a node's projected size drops below pixel_error pixels; hysteresis widens that
+        // threshold by the given fraction in whichever direction keeps last frame's decision.
+        // nodes less solid than min_occupancy are dropped instead of drawn coarse
+        void select(const glm::mat4 &clip, float viewport_pixels, float pixel_error, float hysteresis,
+                    std::vector<glm::vec3> &color, std::vector<uint64_t> &location, std::vector<int32_t> &depth,
+                    LodStats *stats = nullptr, float min_occupancy = 0.f);
+
+        [[nodiscard]] const std::vector<LodNode> &get_nodes() const;
+    };
+
+    inline LodTree::LodTree(const Octree *tree)
+    {
+        flatten(tree, 0);
+        refined.assign(nodes.size(), 0);
+    }
+
+    // returns the node's occupancy; children are weighted by how much of them is solid
+    inline float LodTree::flatten(const Octree *node, const uint8_t octant)
+    {
+        if (node->empty()) return 0;
+
+        const auto index = static_cast<uint32_t>(nodes.size());
+        nodes.push_back({node->get_color(), 1.f, index + 1, octant});
+        if (node->leaf()) return 1.f;
+
+        glm::vec3 color{0, 0, 0};
+        float occupancy = 0;
+        for (uint8_t i = 0; i < 8; i++)
+        {
+            const size_t child = nodes.size();
+            const float o = flatten(node->get_children()[i], i);
+            if (o == 0) continue;
+            color += nodes[child].color * o;
+            occupancy += o;
+        }
+
+        // uncollapsed all-empty nodes are dropped like empties
+        if (occupancy == 0)
+        {
+            nodes.resize(index);
+            return 0;
+        }
+
+        nodes[index].color = color / occupancy;
+        nodes[index].occupancy = occupancy / 8.f;
+        nodes[index].end = static_cast<uint32_t>(nodes.size());
+        return nodes[index].occupancy;
+    }
+
+    inline const std::vector<LodNode> &LodTree::get_nodes() const
+    {
+        return nodes;
+    }
+
+    inline void LodTree::select(const glm::mat4 &clip, const float viewport_pixels, const float pixel_error, const float hysteresis,
+                                std::vector<glm::vec3> &color, std::vector<uint64_t> &location, std::vector<int32_t> &depth,
+                                LodStats *stats, const float min_occupancy)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        color.clear();
+        location.clear();
+        depth.clear();
+        if (nodes.empty()) return;
+
+        // clip space size of a unit box along x and y
+        glm::vec3 extent{0, 0, 0};
+        for (int c = 0; c < 3; c++)
+        {
+            extent.x += std::abs(clip[c][0]);
+            extent.y += std::abs(clip[c][1]);
+        }
+        const float unit_pixels = std::max(extent.x, extent.y) * viewport_pixels * 0.5f;
+
+        LodStats local{};
+        struct Entry
+        {
+            uint32_t index;
+            int32_t depth;
+            uint64_t path;
+            glm::vec3 center;
+            float half;
+        };
+        std::vector<Entry> stack{{0, 0, 0, glm::vec3{0, 0, 0}, 0.5f}};
+
+        while (!stack.empty())
+        {
+            const Entry e = stack.back();
+            stack.pop_back();
+            const LodNode &node = nodes[e.index];
+            const bool leaf = node.end == e.index + 1;
+
+            bool refine = !leaf;
+            if (refine)
+            {
+                const float w = (clip * glm::vec4(e.center, 1.f)).w;
+                // behind the eye there is no meaningful size, keep refining
+                if (w > 0)
+                {
+                    const float pixels = unit_pixels * 2.f * e.half / w;
+                    const float threshold = pixel_error * (refined[e.index] ? 1.f - hysteresis : 1.f + hysteresis);
+                    refine = pixels > threshold;
+                }
+            }
+            refined[e.index] = refine;
+
+            if (!refine)
+            {
+                if (!leaf && node.occupancy < min_occupancy) continue;
+                color.push_back(node.color);
+                location.push_back(e.path);
+                depth.push_back(e.depth);
+                local.coarse += !leaf;
+                continue;
+            }
+
+            // reversed so the output keeps LinVox's leaf order
+            uint32_t children[8];
+            int count = 0;
+            for (uint32_t child = e.index + 1; child < node.end; child = nodes[child].end) children[count++] = child;
+            while (count--)
+            {
+                const uint8_t octant = nodes[children[count]].octant;
+                stack.push_back({
+                    children[count], e.depth + 1,
+                    e.path + (static_cast<uint64_t>(octant) << 3 * e.depth),
+                    e.center + DCENTERS[octant] * (e.half * 0.5f), e.half * 0.5f
+                });
+            }
+        }
+
+        local.selected = location.size();
+        local.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (stats) *stats = local;
+    }
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include <glm/vec3.hpp>
+#include "voxel.hpp"
+#include "norm.hpp"
+
+namespace vox
+{
+    struct LossyCullStats
+    {
+        size_t leaves_before = 0;
+        size_t leaves_after = 0;
+        float max_error = 0;        // largest deltaE between an input leaf and the leaf now covering it
+
+        [[nodiscard]] double reduction() const
+        {
+            return leaves_after ? static_cast<double>(leaves_before) / static_cast<double>(leaves_after) : 0.0;
+        }
+    };
+
+    // labs collects the input leaves of subtrees that could still merge; returns the subtree's current max error
+    inline float lossyCull(Octree *node, const float tolerance, std::vector<glm::vec3> &labs, LossyCullStats &stats)
+    {
+        if (node->empty()) return 0;
+        if (node->leaf())
+        {
+            labs.push_back(lp::srgbToLab(node->get_color()));
+            stats.leaves_before++;
+            return 0;
+        }
+
+        const size_t first = labs.size();
+        const auto children = node->get_children();
+        float error = 0;
+        for (Octree *child : children) error = std::max(error, lossyCull(child, tolerance, labs, stats));
+
+        if (node->collapse()) return error;
+
+        // only full sets of leaves merge, anything else would change the shape
+        const bool leaves = std::all_of(children.begin(), children.end(), [](const Octree *c) { return c->leaf(); });
+        if (!leaves)
+        {
+            labs.resize(first);
+            return error;
+        }
+
+        // children are equal volumes, so their mean is the volume weighted mean of the input leaves
+        glm::vec3 color{0, 0, 0};
+        for (const Octree *child : children) color += child->get_color();
+        color /= 8.f;
+
+        // measured against the input leaves, not the children, so error does not pile up level by level
+        const glm::vec3 lab = lp::srgbToLab(color);
+        float merged = 0;
+        for (size_t i = first; i < labs.size() && merged <= tolerance; i++)
+            merged = std::max(merged, lp::deltaE(lab, labs[i]));
+
+        if (merged > tolerance)
+        {
+            labs.resize(first);
+            return error;
+        }
+
+        node->make_leaf(color);
+        return merged;
+    }
+
+    // like Octree::cull, but also merges eight leaves whose colors are all within tolerance (CIE76 deltaE)
+    // of their mean. a tolerance of 0 gives the same tree as cull
+    inline LossyCullStats lossyCull(Octree *tree, const float tolerance)
+    {
+        LossyCullStats stats;
+        std::vector<glm::vec3> labs;
+        stats.max_error = lossyCull(tree, tolerance, labs, stats);
+
+        std::vector<const Octree *> stack{tree};
+        while (!stack.empty())
+        {
+            const Octree *node = stack.back();
+            stack.pop_back();
+            if (node->leaf()) stats.leaves_after++;
+            if (node->node()) for (const Octree *child : node->get_children()) stack.push_back(child);
+        }
+        return stats;
+    }
+}
@@ -10,8 +10,12 @@
 #include "norm.hpp"
 #include "voxel.hpp"
 #include "voxel_linearized.hpp"
-// #include "scene.hpp"
+#include "voxel_mesh.hpp"
+#include "scene.hpp"
+#include "world.hpp"
 #include "generators.hpp"
+#include "arena.hpp"
+#include "lossy.hpp"
 
 int main()
 {
@@ -39,15 +43,35 @@ int main()
 	// 	), glm::vec3{0,0,0}, 0.5, 8
 	// );
 
-	const auto model_pc = vox::genericPointCloud(
-		vox::randomPointCloud(4500),
-		glm::vec3{0,0,0}, 0.5, 5
-	);
+	const auto model_pc = vox::makeTree([](vox::OctreeArena &arena)
+	{
+		return vox::mortonPointCloud(
+			vox::randomPointCloud(4500),
+			glm::vec3{0,0,0}, 0.5, 5, &arena
+		);
+	});
 	//
 	// std::cout << "node count: " << model_pc->node_count() << std::endl;
 	model_pc->cull();
-	// vox::Voxel point_cloud(model_pc);
-	lin::LinVox point_cloud(model_pc);
+	// vox::lossyCull(model_pc.get(), 2.3f);
+	// vox::Voxel point_cloud(model_pc.get());
+	lin::LinVox point_cloud(model_pc.get());
+	// lin::MeshVox point_cloud(model_pc.get());
+	// point_cloud.enable_culling(model_pc.get());
+	// point_cloud.enable_lod(model_pc.get(), 2.f);
+
+	// vox::AsyncBuild build(vox::pointCloudCells(vox::randomPointCloud(4500), 2), 5, 2);
+	// lin::LinVox point_cloud(build);
+
+	// lin::Scene point_cloud;
+	// for (int i = 0; i < 4; i++)
+	// 	point_cloud.add(model_pc.get(), glm::translate(glm::mat4{1.f}, glm::vec3{-0.375f + 0.25f * i, 0, 0}) * glm::scale(glm::mat4{1.f}, glm::vec3{0.25f}));
+
+	// chunks are written once, then paged around the focus every frame, e.g. from a render loop:
+	// vox::writeWorldChunks(vox::xyzToPointCloud("/home/lukas/projects/voxels/pcd/city.xyz", glm::vec3{0.6, 0.6, 0.6}), "/home/lukas/projects/voxels/world", {20.0, 11});
+	// vox::PagedWorld world("/home/lukas/projects/voxels/world", {20.0, 11}, static_cast<size_t>(2) << 30, 2, 2, lin::Scene::INSTANCE_BYTES);
+	// lin::WorldScene world_scene(point_cloud);
+	// world_scene.sync(world, world.update(focus), focus, 100.0);
 
 	const ctx::Window win2(640, 640);
 	win2.run(point_cloud);
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace vox
+{
+    // read-only mmap of a whole file
+    class MappedFile
+    {
+        void *mapping = nullptr;
+        size_t mapping_size = 0;
+
+    public:
+        explicit MappedFile(const std::string &path);
+        ~MappedFile();
+        MappedFile(MappedFile &&other) noexcept;
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        [[nodiscard]] const std::byte *data() const;
+        [[nodiscard]] size_t size() const;
+        [[nodiscard]] std::string_view text() const;
+        // false when the kernel rejects the advice
+        bool advise(int advice) const;
+    };
+
+    inline MappedFile::MappedFile(const std::string &path)
+    {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("Could not open file: " + path);
+
+        struct stat info{};
+        if (fstat(fd, &info) != 0)
+        {
+            close(fd);
+            throw std::runtime_error("Could not stat file: " + path);
+        }
+
+        mapping_size = static_cast<size_t>(info.st_size);
+        if (mapping_size == 0)
+        {
+            close(fd);
+            return;
+        }
+
+        mapping = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED)
+        {
+            mapping = nullptr;
+            throw std::runtime_error("Could not map file: " + path);
+        }
+    }
+
+    inline MappedFile::~MappedFile()
+    {
+        if (mapping) munmap(mapping, mapping_size);
+    }
+
+    inline MappedFile::MappedFile(MappedFile &&other) noexcept
+    {
+        std::swap(mapping, other.mapping);
+        std::swap(mapping_size, other.mapping_size);
+    }
+
+    inline const std::byte *MappedFile::data() const
+    {
+        return static_cast<const std::byte *>(mapping);
+    }
+
+    inline size_t MappedFile::size() const
+    {
+        return mapping_size;
+    }
+
+    inline std::string_view MappedFile::text() const
+    {
+        return {static_cast<const char *>(mapping), mapping_size};
+    }
+
+    inline bool MappedFile::advise(const int advice) const
+    {
+        return !mapping || madvise(mapping, mapping_size, advice) == 0;
+    }
+}
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include "mapped_file.hpp"
+#include "svo.hpp"
+#include "voxel_linearized.hpp"
+
+namespace vox
+{
+    // on-disk layout: header followed by 16 byte aligned sections of
+    // svo nodes, svo leaves, instance colors, instance locations and instance depths
+    constexpr char MODEL_FILE_MAGIC[4] = {'V', 'O', 'X', 'M'};
+    constexpr uint32_t MODEL_FILE_VERSION = 2;
+
+    struct ModelFileHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t root;
+        uint32_t reserved;
+        uint64_t node_count;
+        uint64_t leaf_count;
+        uint64_t instance_count;
+        uint64_t nodes_offset;
+        uint64_t leaves_offset;
+        uint64_t color_offset;
+        uint64_t location_offset;
+        uint64_t depth_offset;
+        uint64_t file_size;
+    };
+
+    static_assert(sizeof(SvoNode) == 12 && sizeof(glm::vec3) == 12 && sizeof(GLint) == 4 && sizeof(GLuint64) == 8,
+        "model file sections assume packed 12 byte nodes and colors");
+
+    inline uint64_t alignSection(const uint64_t offset)
+    {
+        return (offset + 15) & ~static_cast<uint64_t>(15);
+    }
+
+    // writes the culled svo together with the already linearized instances, instances may be omitted
+    inline void saveModel(const std::string &path, const Svo &svo, const lin::LinVox *instances = nullptr)
+    {
+        const SvoView view = svo.view();
+        const uint64_t instance_count = instances ? instances->get_location().size() : 0;
+
+        ModelFileHeader header{};
+        std::memcpy(header.magic, MODEL_FILE_MAGIC, 4);
+        header.version = MODEL_FILE_VERSION;
+        header.root = view.root;
+        header.node_count = view.nodes.size();
+        header.leaf_count = view.leaves.size();
+        header.instance_count = instance_count;
+        header.nodes_offset = alignSection(sizeof(ModelFileHeader));
+        header.leaves_offset = alignSection(header.nodes_offset + header.node_count * sizeof(SvoNode));
+        header.color_offset = alignSection(header.leaves_offset + header.leaf_count * sizeof(glm::vec3));
+        header.location_offset = alignSection(header.color_offset + instance_count * sizeof(glm::vec3));
+        header.depth_offset = alignSection(header.location_offset + instance_count * sizeof(GLuint64));
+        header.file_size = header.depth_offset + instance_count * sizeof(GLint);
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file) throw std::runtime_error("Could not open model file for writing: " + path);
+
+        const auto section = [&file](const uint64_t offset, const void *data, const uint64_t size)
+        {
+            static constexpr char padding[16] = {};
+            file.write(padding, static_cast<std::streamsize>(offset - static_cast<uint64_t>(file.tellp())));
+            file.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+        };
+
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        section(header.nodes_offset, view.nodes.data(), header.node_count * sizeof(SvoNode));
+        section(header.leaves_offset, view.leaves.data(), header.leaf_count * sizeof(glm::vec3));
+        if (instances)
+        {
+            section(header.color_offset, instances->get_color().data(), instance_count * sizeof(glm::vec3));
+            section(header.location_offset, instances->get_location().data(), instance_count * sizeof(GLuint64));
+            section(header.depth_offset, instances->get_depth().data(), instance_count * sizeof(GLint));
+        }
+        else section(header.depth_offset, nullptr, 0);
+
+        if (!file) throw std::runtime_error("Failed writing model file: " + path);
+    }
+
+    // read-only mapping of a model file, all views point straight into the mapping
+    class MappedModel
+    {
+        MappedFile file;
+        const ModelFileHeader *header = nullptr;
+
+        template<typename T>
+        std::span<const T> section(uint64_t offset, uint64_t count) const;
+
+    public:
+        explicit MappedModel(const std::string &path);
+        void prefault() const;
+
+        [[nodiscard]] SvoView svo() const;
+        [[nodiscard]] std::span<const glm::vec3> instance_color() const;
+        [[nodiscard]] std::span<const GLuint64> instance_location() const;
+        [[nodiscard]] std::span<const GLint> instance_depth() const;
+    };
+
+    // written so no offset or count a corrupt header holds can overflow the check
+    template<typename T>
+    bool sectionFits(const uint64_t offset, const uint64_t count, const uint64_t file_size)
+    {
+        return offset <= file_size && offset % alignof(T) == 0 && count <= (file_size - offset) / sizeof(T);
+    }
+
+    inline MappedModel::MappedModel(const std::string &path) : file(path)
+    {
+        if (file.size() < sizeof(ModelFileHeader)) throw std::runtime_error("Model file too short: " + path);
+
+        header = reinterpret_cast<const ModelFileHeader *>(file.data());
+        if (std::memcmp(header->magic, MODEL_FILE_MAGIC, 4) != 0) throw std::runtime_error("Not a model file: " + path);
+        if (header->version != MODEL_FILE_VERSION) throw std::runtime_error("Unsupported model file version: " + path);
+
+        const uint64_t size = header->file_size;
+        bool valid =
+            header->root <= OCTANT_NODE &&
+            size <= file.size() &&
+            sectionFits<SvoNode>(header->nodes_offset, header->node_count, size) &&
+            sectionFits<glm::vec3>(header->leaves_offset, header->leaf_count, size) &&
+            sectionFits<glm::vec3>(header->color_offset, header->instance_count, size) &&
+            sectionFits<GLuint64>(header->location_offset, header->instance_count, size) &&
+            sectionFits<GLint>(header->depth_offset, header->instance_count, size) &&
+            (header->root != OCTANT_NODE || header->node_count > 0) &&
+            (header->root != OCTANT_LEAF || header->leaf_count > 0);
+
+        // once here, so traversals can index without checks. nodes are stored breadth first, children always
+        // come after their parent, which also rules out cycles
+        const std::span<const SvoNode> nodes = valid ? section<SvoNode>(header->nodes_offset, header->node_count) : std::span<const SvoNode>{};
+        for (size_t i = 0; i < nodes.size() && valid; i++)
+        {
+            const SvoNode &node = nodes[i];
+            const int inner = std::popcount(static_cast<uint8_t>(node.valid_mask & ~node.leaf_mask));
+            const int leaves = std::popcount(node.leaf_mask);
+            valid =
+                (node.leaf_mask & ~node.valid_mask) == 0 &&
+                (inner == 0 || (node.first_child > i && node.first_child + static_cast<uint64_t>(inner) <= header->node_count)) &&
+                node.first_leaf + static_cast<uint64_t>(leaves) <= header->leaf_count;
+        }
+
+        if (!valid) throw std::runtime_error("Corrupt model file: " + path);
+
+        file.advise(MADV_WILLNEED);
+    }
+
+    // pages the whole file in, so whichever thread calls this takes the faults instead of the first draw.
+    // kernels without MADV_POPULATE_READ get one volatile read per page, which the compiler has to keep
+    inline void MappedModel::prefault() const
+    {
+#ifdef MADV_POPULATE_READ
+        if (file.advise(MADV_POPULATE_READ)) return;
+#endif
+        const volatile std::byte *bytes = file.data();
+        for (size_t offset = 0; offset < file.size(); offset += 4096) (void)bytes[offset];
+    }
+
+    template<typename T>
+    std::span<const T> MappedModel::section(const uint64_t offset, const uint64_t count) const
+    {
+        return {reinterpret_cast<const T *>(file.data() + offset), count};
+    }
+
+    inline SvoView MappedModel::svo() const
+    {
+        return {
+            static_cast<EOctant>(header->root),
+            section<SvoNode>(header->nodes_offset, header->node_count),
+            section<glm::vec3>(header->leaves_offset, header->leaf_count)
+        };
+    }
+
+    inline std::span<const glm::vec3> MappedModel::instance_color() const
+    {
+        return section<glm::vec3>(header->color_offset, header->instance_count);
+    }
+
+    inline std::span<const GLuint64> MappedModel::instance_location() const
+    {
+        return section<GLuint64>(header->location_offset, header->instance_count);
+    }
+
+    inline std::span<const GLint> MappedModel::instance_depth() const
+    {
+        return section<GLint>(header->depth_offset, header->instance_count);
+    }
+}
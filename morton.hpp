@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <array>
+#include <glm/vec3.hpp>
+#include <glm/common.hpp>
+
+namespace vox
+{
+    // 21 bits per axis fit into a 63 bit key
+    constexpr int MORTON_MAX_DEPTH = 21;
+
+    // morton code (x | y << 1 | z << 2, bit set = positive half) -> DCENTERS index
+    constexpr std::array<int, 8> MORTON_OCTANTS = {6, 7, 5, 4, 2, 3, 1, 0};
+    // DCENTERS index -> morton code
+    constexpr std::array<int, 8> OCTANT_MORTONS = {7, 6, 4, 5, 3, 2, 0, 1};
+
+    inline uint64_t spreadBits3(uint64_t v)
+    {
+        v &= 0x1fffff;
+        v = (v | v << 32) & 0x001f00000000ffffull;
+        v = (v | v << 16) & 0x001f0000ff0000ffull;
+        v = (v | v << 8)  & 0x100f00f00f00f00full;
+        v = (v | v << 4)  & 0x10c30c30c30c30c3ull;
+        v = (v | v << 2)  & 0x1249249249249249ull;
+        return v;
+    }
+
+    inline uint64_t compactBits3(uint64_t v)
+    {
+        v &= 0x1249249249249249ull;
+        v = (v | v >> 2)  & 0x10c30c30c30c30c3ull;
+        v = (v | v >> 4)  & 0x100f00f00f00f00full;
+        v = (v | v >> 8)  & 0x001f0000ff0000ffull;
+        v = (v | v >> 16) & 0x001f00000000ffffull;
+        v = (v | v >> 32) & 0x1fffff;
+        return v;
+    }
+
+    inline uint64_t mortonEncode(const uint32_t x, const uint32_t y, const uint32_t z)
+    {
+        return spreadBits3(x) | spreadBits3(y) << 1 | spreadBits3(z) << 2;
+    }
+
+    inline void mortonDecode(const uint64_t key, uint32_t &x, uint32_t &y, uint32_t &z)
+    {
+        x = static_cast<uint32_t>(compactBits3(key));
+        y = static_cast<uint32_t>(compactBits3(key >> 1));
+        z = static_cast<uint32_t>(compactBits3(key >> 2));
+    }
+
+    // quantizes a point into the 2^depth grid spanning center +- norm, false if outside
+    inline bool mortonQuantize(const glm::vec3 point, const glm::vec3 center, const float norm, const int depth, uint64_t &key)
+    {
+        const float cells = static_cast<float>(1u << depth);
+        const glm::vec3 grid = (point - center + glm::vec3(norm)) * (cells / (2.f * norm));
+
+        if (grid.x < 0 || grid.y < 0 || grid.z < 0) return false;
+        if (grid.x >= cells || grid.y >= cells || grid.z >= cells) return false;
+
+        key = mortonEncode(
+            static_cast<uint32_t>(grid.x),
+            static_cast<uint32_t>(grid.y),
+            static_cast<uint32_t>(grid.z)
+        );
+        return true;
+    }
+
+    // octant (DCENTERS index) taken at level 1..depth of a key
+    inline int mortonOctant(const uint64_t key, const int level, const int depth)
+    {
+        return MORTON_OCTANTS[(key >> 3 * (depth - level)) & 7];
+    }
+
+    struct MortonEntry
+    {
+        uint64_t key;
+        uint32_t index;
+    };
+
+    // LSD radix sort on the low key_bits bits, stable
+    inline void radixSort(std::vector<MortonEntry> &entries, const int key_bits)
+    {
+        std::vector<MortonEntry> buffer(entries.size());
+
+        for (int shift = 0; shift < key_bits; shift += 8)
+        {
+            std::array<size_t, 257> offsets{};
+            for (const auto &e : entries) offsets[((e.key >> shift) & 0xff) + 1]++;
+            for (int i = 0; i < 256; i++) offsets[i + 1] += offsets[i];
+            for (const auto &e : entries) buffer[offsets[(e.key >> shift) & 0xff]++] = e;
+            entries.swap(buffer);
+        }
+    }
+}
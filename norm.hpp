@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cmath>
 #include <glm/common.hpp>
 #include <glm/vec3.hpp>
 
@@ -10,4 +11,25 @@ namespace lp
         const glm::vec3 epsilon = glm::abs(eps);
         return glm::max(glm::max(epsilon.x, epsilon.y), epsilon.z);
     }
+
+    // sRGB in [0, 1] to CIELAB, D65 white
+    inline glm::vec3 srgbToLab(const glm::vec3 rgb)
+    {
+        const auto linear = [](const float c) { return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f); };
+        const float r = linear(rgb.r), g = linear(rgb.g), b = linear(rgb.b);
+
+        const auto f = [](const float t) { return t > 216.f / 24389.f ? std::cbrt(t) : (24389.f / 27.f * t + 16.f) / 116.f; };
+        const float fx = f((0.4124564f * r + 0.3575761f * g + 0.1804375f * b) / 0.95047f);
+        const float fy = f(0.2126729f * r + 0.7151522f * g + 0.0721750f * b);
+        const float fz = f((0.0193339f * r + 0.1191920f * g + 0.9503041f * b) / 1.08883f);
+
+        return {116.f * fy - 16.f, 500.f * (fx - fy), 200.f * (fy - fz)};
+    }
+
+    // CIE76 distance of two Lab colors, around 2.3 is the just noticeable difference
+    inline float deltaE(const glm::vec3 lab0, const glm::vec3 lab1)
+    {
+        const glm::vec3 d = lab0 - lab1;
+        return std::sqrt(d.x * d.x + d.y * d.y + d.z * d.z);
+    }
 }
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+#include <glm/vec3.hpp>
+
+namespace vox
+{
+    constexpr int PALETTE_MAX = 256;
+
+    // median cut palette over a 5 bit per channel histogram; colors are looked up through the same
+    // 15 bit grid, so indexing a color of the input is one table read
+    class Palette
+    {
+        struct Bin
+        {
+            uint16_t key;
+            uint32_t count;
+            glm::vec3 sum;
+        };
+
+        std::vector<glm::vec3> colors;
+        std::vector<uint16_t> lookup;     // NO_ENTRY for grid cells the input never touched
+
+        static constexpr uint16_t NO_ENTRY = 0xffff;
+
+        static uint16_t bin_key(glm::vec3 color);
+        static int bin_channel(uint16_t key, int channel);
+        [[nodiscard]] uint8_t nearest(glm::vec3 color) const;
+
+    public:
+        explicit Palette(std::span<const glm::vec3> input, int size = PALETTE_MAX);
+        [[nodiscard]] uint8_t index(glm::vec3 color) const;
+        [[nodiscard]] const std::vector<glm::vec3> &get_colors() const;
+    };
+
+    inline uint16_t Palette::bin_key(const glm::vec3 color)
+    {
+        const auto q = [](const float c) { return static_cast<uint16_t>(std::lround(std::clamp(c, 0.f, 1.f) * 31.f)); };
+        return q(color.r) | q(color.g) << 5 | q(color.b) << 10;
+    }
+
+    inline int Palette::bin_channel(const uint16_t key, const int channel)
+    {
+        return key >> 5 * channel & 31;
+    }
+
+    inline Palette::Palette(const std::span<const glm::vec3> input, int size)
+    {
+        size = std::clamp(size, 1, PALETTE_MAX);
+
+        std::vector<Bin> bins(1 << 15);
+        for (size_t i = 0; i < bins.size(); i++) bins[i] = {static_cast<uint16_t>(i), 0, glm::vec3{0, 0, 0}};
+        for (const glm::vec3 color : input)
+        {
+            Bin &bin = bins[bin_key(color)];
+            bin.count++;
+            bin.sum += color;
+        }
+        std::erase_if(bins, [](const Bin &bin) { return bin.count == 0; });
+
+        // boxes are ranges of bins; the one with the widest channel splits at its weighted median
+        struct Box
+        {
+            size_t first, last;
+            int channel, extent;
+        };
+        const auto measure = [&bins](const size_t first, const size_t last)
+        {
+            Box box{first, last, 0, -1};
+            for (int c = 0; c < 3; c++)
+            {
+                int lo = 31, hi = 0;
+                for (size_t i = first; i < last; i++)
+                {
+                    lo = std::min(lo, bin_channel(bins[i].key, c));
+                    hi = std::max(hi, bin_channel(bins[i].key, c));
+                }
+                if (hi - lo > box.extent)
+                {
+                    box.channel = c;
+                    box.extent = hi - lo;
+                }
+            }
+            return box;
+        };
+
+        std::vector<Box> boxes;
+        if (!bins.empty()) boxes.push_back(measure(0, bins.size()));
+        while (static_cast<int>(boxes.size()) < size)
+        {
+            const auto widest = std::max_element(boxes.begin(), boxes.end(), [](const Box &l, const Box &r) { return l.extent < r.extent; });
+            if (widest == boxes.end() || widest->extent <= 0) break;
+
+            const Box box = *widest;
+            std::sort(bins.begin() + static_cast<std::ptrdiff_t>(box.first), bins.begin() + static_cast<std::ptrdiff_t>(box.last),
+                      [c = box.channel](const Bin &l, const Bin &r) { return bin_channel(l.key, c) < bin_channel(r.key, c); });
+
+            uint64_t total = 0, running = 0;
+            for (size_t i = box.first; i < box.last; i++) total += bins[i].count;
+            size_t split = box.first + 1;
+            for (size_t i = box.first; i < box.last - 1; i++)
+            {
+                running += bins[i].count;
+                split = i + 1;
+                if (running * 2 >= total) break;
+            }
+
+            *widest = measure(box.first, split);
+            boxes.push_back(measure(split, box.last));
+        }
+
+        for (const Box &box : boxes)
+        {
+            glm::vec3 sum{0, 0, 0};
+            uint64_t count = 0;
+            for (size_t i = box.first; i < box.last; i++)
+            {
+                sum += bins[i].sum;
+                count += bins[i].count;
+            }
+            colors.push_back(sum / static_cast<float>(count));
+        }
+        if (colors.empty()) colors.emplace_back(0, 0, 0);
+
+        lookup.assign(1 << 15, NO_ENTRY);
+        for (const Bin &bin : bins) lookup[bin.key] = nearest(bin.sum / static_cast<float>(bin.count));
+    }
+
+    inline uint8_t Palette::nearest(const glm::vec3 color) const
+    {
+        float best = std::numeric_limits<float>::infinity();
+        uint8_t index = 0;
+        for (size_t i = 0; i < colors.size(); i++)
+        {
+            const glm::vec3 d = colors[i] - color;
+            const float distance = d.x * d.x + d.y * d.y + d.z * d.z;
+            if (distance < best)
+            {
+                best = distance;
+                index = static_cast<uint8_t>(i);
+            }
+        }
+        return index;
+    }
+
+    inline uint8_t Palette::index(const glm::vec3 color) const
+    {
+        // colors outside the input (edits, filtered lod colors) take a full search
+        const uint16_t entry = lookup[bin_key(color)];
+        return entry != NO_ENTRY ? static_cast<uint8_t>(entry) : nearest(color);
+    }
+
+    inline const std::vector<glm::vec3> &Palette::get_colors() const
+    {
+        return colors;
+    }
+}
@@ -0,0 +1,344 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <glm/vec3.hpp>
+#include "cloud_io.hpp"
+
+namespace vox
+{
+    struct PcdField
+    {
+        std::string name;
+        int size = 4;
+        char type = 'F';
+        int count = 1;
+        size_t offset = 0;  // byte offset inside one point record
+    };
+
+    struct PcdHeader
+    {
+        std::vector<PcdField> fields;
+        size_t points = 0;
+        size_t point_size = 0;
+        std::string data;
+        size_t data_offset = 0;  // first byte after the DATA line
+
+        [[nodiscard]] int field_index(std::string_view name) const;
+    };
+
+    inline int PcdHeader::field_index(const std::string_view name) const
+    {
+        for (size_t i = 0; i < fields.size(); i++)
+            if (fields[i].name == name) return static_cast<int>(i);
+        return -1;
+    }
+
+    inline PcdHeader parsePcdHeader(const std::string_view text)
+    {
+        PcdHeader header;
+        size_t width = 0, height = 1;
+        bool has_points = false;
+        size_t pos = 0;
+
+        while (pos < text.size())
+        {
+            const size_t end = std::min(text.find('\n', pos), text.size());
+            std::istringstream iss{std::string(text.substr(pos, end - pos))};
+            pos = end + 1;
+
+            std::string key;
+            if (!(iss >> key) || key[0] == '#') continue;
+
+            if (key == "FIELDS")
+            {
+                std::string name;
+                while (iss >> name) header.fields.push_back({name});
+            }
+            else if (key == "SIZE" || key == "TYPE" || key == "COUNT")
+            {
+                for (auto &field : header.fields)
+                {
+                    std::string value;
+                    if (!(iss >> value)) throw std::runtime_error("Malformed pcd " + key + " line.");
+                    if (key == "SIZE") field.size = std::stoi(value);
+                    if (key == "TYPE") field.type = value[0];
+                    if (key == "COUNT") field.count = std::stoi(value);
+                }
+            }
+            else if (key == "WIDTH") iss >> width;
+            else if (key == "HEIGHT") iss >> height;
+            else if (key == "POINTS")
+            {
+                iss >> header.points;
+                has_points = true;
+            }
+            else if (key == "DATA")
+            {
+                iss >> header.data;
+                header.data_offset = std::min(pos, text.size());
+                break;
+            }
+        }
+
+        if (header.data.empty()) throw std::runtime_error("Missing pcd DATA line.");
+        if (!has_points) header.points = width * height;
+
+        for (auto &field : header.fields)
+        {
+            field.offset = header.point_size;
+            header.point_size += static_cast<size_t>(field.size) * field.count;
+        }
+
+        return header;
+    }
+
+    // reads one scalar of any pcd TYPE/SIZE as float
+    inline float pcdScalar(const std::byte *data, const PcdField &field)
+    {
+        switch (field.type << 8 | field.size)
+        {
+            case 'F' << 8 | 4: { float v; std::memcpy(&v, data, 4); return v; }
+            case 'F' << 8 | 8: { double v; std::memcpy(&v, data, 8); return static_cast<float>(v); }
+            case 'U' << 8 | 1: { uint8_t v; std::memcpy(&v, data, 1); return v; }
+            case 'U' << 8 | 2: { uint16_t v; std::memcpy(&v, data, 2); return v; }
+            case 'U' << 8 | 4: { uint32_t v; std::memcpy(&v, data, 4); return static_cast<float>(v); }
+            case 'I' << 8 | 1: { int8_t v; std::memcpy(&v, data, 1); return v; }
+            case 'I' << 8 | 2: { int16_t v; std::memcpy(&v, data, 2); return v; }
+            case 'I' << 8 | 4: { int32_t v; std::memcpy(&v, data, 4); return static_cast<float>(v); }
+            default: throw std::runtime_error("Unsupported pcd field type.");
+        }
+    }
+
+    // lzf as written by pcl for DATA binary_compressed, returns false on corrupt input
+    inline bool lzfDecompress(const std::byte *in, const size_t in_size, std::byte *out, const size_t out_size)
+    {
+        const auto *ip = reinterpret_cast<const uint8_t *>(in);
+        const auto *in_end = ip + in_size;
+        auto *op = reinterpret_cast<uint8_t *>(out);
+        auto *out_begin = op;
+        auto *out_end = op + out_size;
+
+        while (ip < in_end)
+        {
+            size_t ctrl = *ip++;
+
+            if (ctrl < 32)
+            {
+                ctrl++;
+                if (op + ctrl > out_end || ip + ctrl > in_end) return false;
+                std::memcpy(op, ip, ctrl);
+                op += ctrl;
+                ip += ctrl;
+                continue;
+            }
+
+            size_t len = ctrl >> 5;
+            if (len == 7)
+            {
+                if (ip >= in_end) return false;
+                len += *ip++;
+            }
+            if (ip >= in_end) return false;
+
+            const size_t back = ((ctrl & 0x1f) << 8) + *ip++ + 1;
+            len += 2;
+            if (back > static_cast<size_t>(op - out_begin) || op + len > out_end) return false;
+
+            // overlapping copy, has to go byte by byte
+            const uint8_t *ref = op - back;
+            for (size_t i = 0; i < len; i++) *op++ = *ref++;
+        }
+
+        return op == out_end;
+    }
+
+    // maps a pcd file and gives per point field access straight from the mapping (binary) or from the
+    // decompressed field-major buffer (binary_compressed); ascii data is exposed as text
+    class MappedPcd
+    {
+        MappedFile file;
+        PcdHeader header;
+        std::vector<std::byte> decompressed;
+        const std::byte *base = nullptr;
+        std::vector<size_t> field_start;
+        std::vector<size_t> field_stride;
+        int xyz[3] = {-1, -1, -1};
+        int rgb = -1;
+
+        [[nodiscard]] const std::byte *field(int index, size_t point) const;
+
+    public:
+        explicit MappedPcd(const std::string &path);
+
+        [[nodiscard]] const PcdHeader &get_header() const;
+        [[nodiscard]] bool ascii() const;
+        [[nodiscard]] std::string_view text() const;
+        [[nodiscard]] size_t size() const;
+        [[nodiscard]] bool has_color() const;
+        [[nodiscard]] glm::vec3 position(size_t point) const;
+        [[nodiscard]] glm::vec3 color(size_t point) const;
+    };
+
+    inline MappedPcd::MappedPcd(const std::string &path) : file(path)
+    {
+        header = parsePcdHeader(file.text());
+
+        xyz[0] = header.field_index("x");
+        xyz[1] = header.field_index("y");
+        xyz[2] = header.field_index("z");
+        rgb = header.field_index("rgb");
+        if (rgb < 0) rgb = header.field_index("rgba");
+        if (xyz[0] < 0 || xyz[1] < 0 || xyz[2] < 0)
+            throw std::runtime_error("Pcd file has no x y z fields: " + path);
+        if (rgb >= 0 && header.fields[rgb].size != 4)
+            throw std::runtime_error("Unsupported pcd rgb field size: " + path);
+
+        if (header.data == "ascii") return;
+
+        const std::byte *data = file.data() + header.data_offset;
+        const size_t data_size = file.size() - header.data_offset;
+
+        if (header.data == "binary")
+        {
+            if (data_size < header.points * header.point_size)
+                throw std::runtime_error("Truncated pcd binary data: " + path);
+
+            base = data;
+            for (const auto &f : header.fields)
+            {
+                field_start.push_back(f.offset);
+                field_stride.push_back(header.point_size);
+            }
+            file.advise(MADV_SEQUENTIAL);
+            return;
+        }
+
+        if (header.data == "binary_compressed")
+        {
+            uint32_t sizes[2];
+            if (data_size < sizeof(sizes)) throw std::runtime_error("Truncated pcd compressed data: " + path);
+            std::memcpy(sizes, data, sizeof(sizes));
+
+            if (sizes[1] != header.points * header.point_size || data_size - sizeof(sizes) < sizes[0])
+                throw std::runtime_error("Inconsistent pcd compressed sizes: " + path);
+
+            decompressed.resize(sizes[1]);
+            if (!lzfDecompress(data + sizeof(sizes), sizes[0], decompressed.data(), decompressed.size()))
+                throw std::runtime_error("Corrupt pcd compressed data: " + path);
+
+            // compressed payload is stored field after field
+            base = decompressed.data();
+            size_t start = 0;
+            for (const auto &f : header.fields)
+            {
+                field_start.push_back(start);
+                field_stride.push_back(static_cast<size_t>(f.size) * f.count);
+                start += header.points * field_stride.back();
+            }
+            return;
+        }
+
+        throw std::runtime_error("Unsupported pcd format error.");
+    }
+
+    inline const PcdHeader &MappedPcd::get_header() const
+    {
+        return header;
+    }
+
+    inline bool MappedPcd::ascii() const
+    {
+        return header.data == "ascii";
+    }
+
+    inline std::string_view MappedPcd::text() const
+    {
+        return file.text().substr(header.data_offset);
+    }
+
+    inline size_t MappedPcd::size() const
+    {
+        return header.points;
+    }
+
+    inline bool MappedPcd::has_color() const
+    {
+        return rgb >= 0;
+    }
+
+    inline const std::byte *MappedPcd::field(const int index, const size_t point) const
+    {
+        return base + field_start[index] + point * field_stride[index];
+    }
+
+    inline glm::vec3 MappedPcd::position(const size_t point) const
+    {
+        return glm::vec3{
+            pcdScalar(field(xyz[0], point), header.fields[xyz[0]]),
+            pcdScalar(field(xyz[1], point), header.fields[xyz[1]]),
+            pcdScalar(field(xyz[2], point), header.fields[xyz[2]])
+        };
+    }
+
+    inline glm::vec3 MappedPcd::color(const size_t point) const
+    {
+        uint32_t packed;
+        std::memcpy(&packed, field(rgb, point), 4);
+        return unpackPackedColor(packed);
+    }
+
+    // ascii rows: one point per line, columns follow FIELDS/COUNT
+    inline AsciiLayout pcdAsciiLayout(const PcdHeader &header)
+    {
+        std::vector<int> column(header.fields.size());
+        AsciiLayout layout;
+        layout.columns = 0;
+        for (size_t i = 0; i < header.fields.size(); i++)
+        {
+            column[i] = layout.columns;
+            layout.columns += header.fields[i].count;
+        }
+
+        layout.x = column[header.field_index("x")];
+        layout.y = column[header.field_index("y")];
+        layout.z = column[header.field_index("z")];
+
+        int rgb = header.field_index("rgb");
+        if (rgb < 0) rgb = header.field_index("rgba");
+        // packed colors are written either as the float with the same bits or as an integer, whatever the
+        // declared type; the parser tells them apart per token
+        if (rgb >= 0) layout.packed = column[rgb];
+
+        return layout;
+    }
+
+    // loads ascii, binary and binary_compressed pcd; model_color is used when the file has no rgb field
+    inline PointCloud pcdToPointCloud(const std::string &pcd_path, glm::vec3 model_color, float scale = 1.0f, unsigned thread_count = std::thread::hardware_concurrency())
+    {
+        const MappedPcd pcd(pcd_path);
+
+        if (pcd.ascii())
+            return parseAsciiParallel(pcd.text(), pcdAsciiLayout(pcd.get_header()), model_color, scale, thread_count);
+
+        PointCloud ret{};
+        ret.reserve(pcd.size());
+
+        for (size_t i = 0; i < pcd.size(); i++)
+        {
+            const glm::vec3 point = pcd.position(i);
+            if (!std::isfinite(point.x) || !std::isfinite(point.y) || !std::isfinite(point.z)) continue;
+
+            ret.emplace_back(point * scale, pcd.has_color() ? pcd.color(i) : model_color);
+        }
+
+        return ret;
+    }
+}
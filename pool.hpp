@@ -0,0 +1,175 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vox
+{
+    // work-stealing thread pool; every worker owns a deque, pops its own back and steals other fronts
+    class ThreadPool
+    {
+        struct Queue
+        {
+            std::mutex mutex;
+            std::deque<std::function<void()>> tasks;
+        };
+
+        std::vector<std::thread> workers;
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::atomic<size_t> queued = 0;
+        std::atomic<size_t> pending = 0;
+        std::atomic<size_t> next_queue = 0;
+        std::atomic<bool> stop = false;
+        std::mutex sleep_mutex;
+        std::condition_variable work_available;
+        std::condition_variable work_done;
+        std::exception_ptr error = nullptr;
+
+        static inline thread_local ThreadPool *current_pool = nullptr;
+        static inline thread_local size_t current_index = 0;
+
+        bool pop(size_t index, std::function<void()> &task);
+        void work(size_t index);
+
+    public:
+        explicit ThreadPool(unsigned thread_count = std::thread::hardware_concurrency());
+        ~ThreadPool();
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        // tasks submitted from inside a task go to the submitting worker's own deque
+        void submit(std::function<void()> task);
+        // blocks until every submitted task (including nested ones) finished, must not be called from a task
+        void wait();
+        [[nodiscard]] unsigned size() const;
+    };
+
+    inline ThreadPool::ThreadPool(unsigned thread_count)
+    {
+        if (thread_count == 0) thread_count = 1;
+
+        for (unsigned i = 0; i < thread_count; i++)
+            queues.push_back(std::make_unique<Queue>());
+
+        for (unsigned i = 0; i < thread_count; i++)
+            workers.emplace_back([this, i] { work(i); });
+    }
+
+    inline ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard lock(sleep_mutex);
+            stop = true;
+        }
+        work_available.notify_all();
+
+        for (auto &worker : workers) worker.join();
+    }
+
+    inline unsigned ThreadPool::size() const
+    {
+        return static_cast<unsigned>(workers.size());
+    }
+
+    inline void ThreadPool::submit(std::function<void()> task)
+    {
+        const size_t index = current_pool == this
+            ? current_index
+            : next_queue++ % queues.size();
+
+        pending++;
+        {
+            std::lock_guard lock(sleep_mutex);
+            queued++;
+        }
+        {
+            std::lock_guard lock(queues[index]->mutex);
+            queues[index]->tasks.push_back(std::move(task));
+        }
+        work_available.notify_one();
+    }
+
+    inline bool ThreadPool::pop(const size_t index, std::function<void()> &task)
+    {
+        {
+            Queue &own = *queues[index];
+            std::lock_guard lock(own.mutex);
+            if (!own.tasks.empty())
+            {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                queued--;
+                return true;
+            }
+        }
+
+        for (size_t i = 1; i < queues.size(); i++)
+        {
+            Queue &victim = *queues[(index + i) % queues.size()];
+            std::lock_guard lock(victim.mutex);
+            if (!victim.tasks.empty())
+            {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                queued--;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    inline void ThreadPool::work(const size_t index)
+    {
+        current_pool = this;
+        current_index = index;
+
+        while (true)
+        {
+            std::function<void()> task;
+            if (!pop(index, task))
+            {
+                std::unique_lock lock(sleep_mutex);
+                work_available.wait(lock, [this] { return stop || queued > 0; });
+                if (stop && queued == 0) return;
+                continue;
+            }
+
+            try
+            {
+                task();
+            }
+            catch (...)
+            {
+                std::lock_guard lock(sleep_mutex);
+                if (!error) error = std::current_exception();
+            }
+
+            if (--pending == 0)
+            {
+                std::lock_guard lock(sleep_mutex);
+                work_done.notify_all();
+            }
+        }
+    }
+
+    inline void ThreadPool::wait()
+    {
+        std::unique_lock lock(sleep_mutex);
+        work_done.wait(lock, [this] { return pending == 0; });
+
+        if (error)
+        {
+            const std::exception_ptr rethrown = error;
+            error = nullptr;
+            std::rethrow_exception(rethrown);
+        }
+    }
+}
@@ -0,0 +1,297 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <queue>
+#include <span>
+#include <vector>
+#include <glm/geometric.hpp>
+#include <glm/vec3.hpp>
+#include "voxel.hpp"
+#include "morton.hpp"
+#include "pool.hpp"
+
+// queries run in model space, the root cell spans [-0.5, 0.5] like it does for the renderers
+namespace vox
+{
+    // a leaf found by a query; path is addressed like LinVox locations and EditRegion
+    struct VoxelRef
+    {
+        const Octree *node = nullptr;   // nullptr when nothing was found
+        glm::vec3 center{0, 0, 0};
+        float half = 0.5f;
+        int depth = 0;
+        uint64_t path = 0;
+    };
+
+    struct Ray
+    {
+        glm::vec3 origin;
+        glm::vec3 direction;
+    };
+
+    struct RayQueryHit
+    {
+        VoxelRef voxel;
+        glm::vec3 color{0, 0, 0};
+        float distance = 0;             // hit point is origin + distance * direction
+        glm::vec3 normal{0, 0, 0};      // face the ray entered through, zero if it started inside the voxel
+    };
+
+    inline VoxelRef childRef(const VoxelRef &parent, const int octant)
+    {
+        return {
+            parent.node->get_children()[octant],
+            parent.center + DCENTERS[octant] * (parent.half * 0.5f), parent.half * 0.5f,
+            parent.depth + 1, parent.path + (static_cast<uint64_t>(octant) << 3 * parent.depth)
+        };
+    }
+
+    inline float boxDistance(const glm::vec3 point, const glm::vec3 center, const float half)
+    {
+        const glm::vec3 outside = glm::max(glm::abs(point - center) - glm::vec3{half, half, half}, glm::vec3{0, 0, 0});
+        return glm::length(outside);
+    }
+
+    // children are visited front to back: the one containing the entry point first, then one axis bit
+    // flips at every midplane the ray crosses inside [t_in, t_out]
+    inline bool raycastNode(const VoxelRef &ref, const float t_in, const float t_out, const int axis, const Ray &ray,
+                            const glm::vec3 inverse, RayQueryHit &hit)
+    {
+        if (ref.node->empty()) return false;
+        if (ref.node->leaf())
+        {
+            hit.voxel = ref;
+            hit.color = ref.node->get_color();
+            hit.distance = t_in;
+            hit.normal = glm::vec3{0, 0, 0};
+            if (axis >= 0) hit.normal[axis] = ray.direction[axis] > 0 ? -1.f : 1.f;
+            return true;
+        }
+
+        struct Crossing
+        {
+            float t;
+            int axis;
+        };
+        std::array<Crossing, 3> crossings{};
+        int count = 0;
+        int code = 0;
+
+        for (int a = 0; a < 3; a++)
+        {
+            const float p = ray.origin[a] + ray.direction[a] * t_in - ref.center[a];
+            if (p > 0 || (p == 0 && ray.direction[a] > 0)) code |= 1 << a;
+
+            if (ray.direction[a] == 0) continue;
+            const float t = (ref.center[a] - ray.origin[a]) * inverse[a];
+            if (t > t_in && t < t_out) crossings[count++] = {t, a};
+        }
+        std::sort(crossings.begin(), crossings.begin() + count, [](const Crossing &l, const Crossing &r) { return l.t < r.t; });
+
+        float t_start = t_in;
+        int entry = axis;
+        for (int k = 0; k <= count; k++)
+        {
+            const float t_end = k < count ? crossings[k].t : t_out;
+            if (raycastNode(childRef(ref, MORTON_OCTANTS[code]), t_start, t_end, entry, ray, inverse, hit)) return true;
+
+            if (k < count)
+            {
+                code ^= 1 << crossings[k].axis;
+                t_start = crossings[k].t;
+                entry = crossings[k].axis;
+            }
+        }
+        return false;
+    }
+
+    // first leaf along the ray within max_distance
+    inline bool raycast(const Octree *tree, const Ray &ray, RayQueryHit &hit, const float max_distance = std::numeric_limits<float>::infinity())
+    {
+        const glm::vec3 inverse{1.f / ray.direction.x, 1.f / ray.direction.y, 1.f / ray.direction.z};
+
+        // slabs of the root cell
+        float t_in = 0;
+        float t_out = max_distance;
+        int axis = -1;
+        for (int a = 0; a < 3; a++)
+        {
+            if (ray.direction[a] == 0)
+            {
+                if (std::abs(ray.origin[a]) > 0.5f) return false;
+                continue;
+            }
+            float t0 = (-0.5f - ray.origin[a]) * inverse[a];
+            float t1 = (0.5f - ray.origin[a]) * inverse[a];
+            if (t0 > t1) std::swap(t0, t1);
+            if (t0 > t_in)
+            {
+                t_in = t0;
+                axis = a;
+            }
+            t_out = std::min(t_out, t1);
+        }
+        if (t_in > t_out) return false;
+
+        return raycastNode({tree}, t_in, t_out, axis, ray, inverse, hit);
+    }
+
+    // leaf containing point, points on a shared face resolve to the positive side
+    inline bool lookup(const Octree *tree, const glm::vec3 point, VoxelRef &voxel)
+    {
+        if (std::abs(point.x) > 0.5f || std::abs(point.y) > 0.5f || std::abs(point.z) > 0.5f) return false;
+
+        VoxelRef ref{tree};
+        while (ref.node->node())
+        {
+            const int code = (point.x >= ref.center.x) | (point.y >= ref.center.y) << 1 | (point.z >= ref.center.z) << 2;
+            ref = childRef(ref, MORTON_OCTANTS[code]);
+        }
+        if (ref.node->empty()) return false;
+
+        voxel = ref;
+        return true;
+    }
+
+    // appends every leaf that overlaps the open box (lo, hi)
+    inline void overlapBox(const Octree *tree, const glm::vec3 lo, const glm::vec3 hi, std::vector<VoxelRef> &voxels)
+    {
+        std::vector<VoxelRef> stack{{tree}};
+        while (!stack.empty())
+        {
+            const VoxelRef ref = stack.back();
+            stack.pop_back();
+            if (ref.node->empty()) continue;
+
+            bool overlaps = true;
+            for (int a = 0; a < 3; a++)
+                overlaps &= ref.center[a] - ref.half < hi[a] && ref.center[a] + ref.half > lo[a];
+            if (!overlaps) continue;
+
+            if (ref.node->leaf())
+            {
+                voxels.push_back(ref);
+                continue;
+            }
+            for (int i = 0; i < 8; i++) stack.push_back(childRef(ref, i));
+        }
+    }
+
+    // appends every leaf closer than radius to center
+    inline void overlapSphere(const Octree *tree, const glm::vec3 center, const float radius, std::vector<VoxelRef> &voxels)
+    {
+        std::vector<VoxelRef> stack{{tree}};
+        while (!stack.empty())
+        {
+            const VoxelRef ref = stack.back();
+            stack.pop_back();
+            if (ref.node->empty() || boxDistance(center, ref.center, ref.half) >= radius) continue;
+
+            if (ref.node->leaf())
+            {
+                voxels.push_back(ref);
+                continue;
+            }
+            for (int i = 0; i < 8; i++) stack.push_back(childRef(ref, i));
+        }
+    }
+
+    // closest leaf to point, best first over box distances; distance is 0 for a point inside a leaf
+    inline bool nearest(const Octree *tree, const glm::vec3 point, VoxelRef &voxel, float *distance = nullptr,
+                        const float max_distance = std::numeric_limits<float>::infinity())
+    {
+        struct Entry
+        {
+            float distance;
+            VoxelRef ref;
+
+            bool operator<(const Entry &other) const
+            {
+                return distance > other.distance;
+            }
+        };
+
+        std::priority_queue<Entry> queue;
+        queue.push({boxDistance(point, glm::vec3{0, 0, 0}, 0.5f), {tree}});
+        while (!queue.empty())
+        {
+            const Entry entry = queue.top();
+            queue.pop();
+            if (entry.distance > max_distance) return false;
+            // only the root can be empty here, children are filtered before they go in
+            if (entry.ref.node->empty()) continue;
+
+            if (entry.ref.node->leaf())
+            {
+                voxel = entry.ref;
+                if (distance) *distance = entry.distance;
+                return true;
+            }
+
+            for (int i = 0; i < 8; i++)
+            {
+                const VoxelRef child = childRef(entry.ref, i);
+                if (child.node->empty()) continue;
+                queue.push({boxDistance(point, child.center, child.half), child});
+            }
+        }
+        return false;
+    }
+
+    // splits count queries into chunks over the pool, or runs them inline without one
+    template<typename F>
+    void forQueryBatch(const size_t count, ThreadPool *pool, F &&body)
+    {
+        constexpr size_t chunk = 256;
+        if (!pool || count <= chunk)
+        {
+            body(0, count);
+            return;
+        }
+
+        for (size_t first = 0; first < count; first += chunk)
+            pool->submit([&body, first, count] { body(first, std::min(first + chunk, count)); });
+        pool->wait();
+    }
+
+    // hits[i].voxel.node stays nullptr for rays that miss
+    inline void raycast(const Octree *tree, std::span<const Ray> rays, std::span<RayQueryHit> hits, ThreadPool *pool = nullptr)
+    {
+        forQueryBatch(rays.size(), pool, [&](const size_t first, const size_t last)
+        {
+            for (size_t i = first; i < last; i++)
+            {
+                hits[i] = {};
+                raycast(tree, rays[i], hits[i]);
+            }
+        });
+    }
+
+    inline void lookup(const Octree *tree, std::span<const glm::vec3> points, std::span<VoxelRef> voxels, ThreadPool *pool = nullptr)
+    {
+        forQueryBatch(points.size(), pool, [&](const size_t first, const size_t last)
+        {
+            for (size_t i = first; i < last; i++)
+            {
+                voxels[i] = {};
+                lookup(tree, points[i], voxels[i]);
+            }
+        });
+    }
+
+    inline void nearest(const Octree *tree, std::span<const glm::vec3> points, std::span<VoxelRef> voxels, ThreadPool *pool = nullptr)
+    {
+        forQueryBatch(points.size(), pool, [&](const size_t first, const size_t last)
+        {
+            for (size_t i = first; i < last; i++)
+            {
+                voxels[i] = {};
+                nearest(tree, points[i], voxels[i]);
+            }
+        });
+    }
+}
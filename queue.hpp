@@ -0,0 +1,96 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace vox
+{
+    // bounded lock-free multi producer multi consumer ring (Vyukov); every cell carries a sequence number
+    // telling whose turn it is, so producers and consumers only contend on their own index
+    template<typename T>
+    class BoundedQueue
+    {
+        struct Cell
+        {
+            std::atomic<size_t> sequence;
+            T value;
+        };
+
+        std::unique_ptr<Cell[]> cells;
+        size_t mask;
+        alignas(64) std::atomic<size_t> head = 0;
+        alignas(64) std::atomic<size_t> tail = 0;
+
+    public:
+        // capacity gets rounded up to a power of two
+        explicit BoundedQueue(size_t capacity);
+        BoundedQueue(const BoundedQueue &) = delete;
+        BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+        // both fail instead of blocking, when full or empty respectively
+        bool try_push(T &&value);
+        bool try_pop(T &value);
+    };
+
+    template<typename T>
+    BoundedQueue<T>::BoundedQueue(const size_t capacity)
+    {
+        const size_t size = std::bit_ceil(std::max<size_t>(capacity, 2));
+        cells = std::make_unique<Cell[]>(size);
+        mask = size - 1;
+        for (size_t i = 0; i < size; i++) cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    template<typename T>
+    bool BoundedQueue<T>::try_push(T &&value)
+    {
+        size_t position = tail.load(std::memory_order_relaxed);
+        Cell *cell;
+        while (true)
+        {
+            cell = &cells[position & mask];
+            const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            const auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+
+            if (difference == 0)
+            {
+                if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+            }
+            else if (difference < 0) return false;
+            else position = tail.load(std::memory_order_relaxed);
+        }
+
+        cell->value = std::move(value);
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    template<typename T>
+    bool BoundedQueue<T>::try_pop(T &value)
+    {
+        size_t position = head.load(std::memory_order_relaxed);
+        Cell *cell;
+        while (true)
+        {
+            cell = &cells[position & mask];
+            const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            const auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position + 1);
+
+            if (difference == 0)
+            {
+                if (head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+            }
+            else if (difference < 0) return false;
+            else position = head.load(std::memory_order_relaxed);
+        }
+
+        value = std::move(cell->value);
+        cell->sequence.store(position + mask + 1, std::memory_order_release);
+        return true;
+    }
+}
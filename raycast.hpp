@@ -0,0 +1,173 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <glm/geometric.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+#include "voxel.hpp"
+#include "pool.hpp"
+#include "query.hpp"
+
+namespace vox
+{
+    struct Framebuffer
+    {
+        int width = 0;
+        int height = 0;
+        std::vector<glm::vec3> color;
+        std::vector<float> depth;       // view space z of the hit, infinity where the ray missed
+        glm::vec3 background{1, 1, 1};  // color of missed pixels, the last one clear() was given
+
+        Framebuffer(int _width, int _height);
+        void clear(glm::vec3 _background = {1, 1, 1});
+        void write_ppm(const std::string &path) const;
+    };
+
+    struct RaycastStats
+    {
+        size_t rays = 0;
+        size_t hits = 0;
+        double ms = 0;
+
+        [[nodiscard]] double rays_per_second() const
+        {
+            return ms > 0 ? static_cast<double>(rays) / ms * 1e3 : 0.0;
+        }
+    };
+
+    // software renderer for machines without a GL context. the view is the same affine model to clip
+    // transform the shaders apply (see lin::modelRotation), rays run along +z in clip space like depth does
+    class Raycaster
+    {
+        const Octree *tree;
+        ThreadPool pool;
+        int tile_size;
+
+    public:
+        explicit Raycaster(const Octree *_tree, unsigned thread_count = std::thread::hardware_concurrency(), int _tile_size = 32);
+        void render(const glm::mat4 &view, Framebuffer &target, RaycastStats *stats = nullptr);
+    };
+
+    inline Framebuffer::Framebuffer(const int _width, const int _height) : width(_width), height(_height)
+    {
+        clear();
+    }
+
+    inline void Framebuffer::clear(const glm::vec3 _background)
+    {
+        background = _background;
+        color.assign(static_cast<size_t>(width) * height, background);
+        depth.assign(static_cast<size_t>(width) * height, std::numeric_limits<float>::infinity());
+    }
+
+    inline void Framebuffer::write_ppm(const std::string &path) const
+    {
+        std::ofstream file(path, std::ios::binary);
+        if (!file) throw std::runtime_error("Could not open image for writing: " + path);
+
+        file << "P6\n" << width << " " << height << "\n255\n";
+        std::vector<uint8_t> row(static_cast<size_t>(width) * 3);
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                const glm::vec3 c = color[static_cast<size_t>(y) * width + x];
+                for (int k = 0; k < 3; k++)
+                    row[x * 3 + k] = static_cast<uint8_t>(std::lround(std::clamp(c[k], 0.f, 1.f) * 255.f));
+            }
+            file.write(reinterpret_cast<const char *>(row.data()), static_cast<std::streamsize>(row.size()));
+        }
+        if (!file) throw std::runtime_error("Could not write image: " + path);
+    }
+
+    inline Raycaster::Raycaster(const Octree *_tree, const unsigned thread_count, const int _tile_size)
+        : tree(_tree), pool(thread_count), tile_size(std::max(_tile_size, 1))
+    {
+    }
+
+    // tiles go to the pool; with an orthographic view every ray shares one direction, so only the origin
+    // differs per pixel and traversal order is the same for the whole frame
+    inline void Raycaster::render(const glm::mat4 &view, Framebuffer &target, RaycastStats *stats)
+    {
+        const auto start = std::chrono::steady_clock::now();
+
+        // inverse of the linear part from its columns: rows are the pairwise cross products over the determinant
+        const glm::vec3 c0{view[0].x, view[0].y, view[0].z};
+        const glm::vec3 c1{view[1].x, view[1].y, view[1].z};
+        const glm::vec3 c2{view[2].x, view[2].y, view[2].z};
+        const glm::vec3 translation{view[3].x, view[3].y, view[3].z};
+        const glm::vec3 r0 = glm::cross(c1, c2), r1 = glm::cross(c2, c0), r2 = glm::cross(c0, c1);
+        const float det = glm::dot(c0, r0);
+        if (det == 0) throw std::runtime_error("Raycast view is not invertible.");
+        const auto toModel = [&](const glm::vec3 v) { return glm::vec3{glm::dot(r0, v), glm::dot(r1, v), glm::dot(r2, v)} / det; };
+
+        // start every ray in front of the whole root cell
+        const float reach = std::abs(c0.z) + std::abs(c1.z) + std::abs(c2.z);
+        const float near = translation.z - reach - 1.f;
+        const glm::vec3 direction = toModel(glm::vec3{0, 0, 1});
+
+        // same point light the shaders use, in clip space
+        const glm::vec3 lamp{0, 1, -1};
+        const glm::vec3 intensity{1.2f, 1.2f, 1.2f};
+
+        std::vector<size_t> tile_hits;
+        const int tiles_x = (target.width + tile_size - 1) / tile_size;
+        const int tiles_y = (target.height + tile_size - 1) / tile_size;
+        tile_hits.assign(static_cast<size_t>(tiles_x) * tiles_y, 0);
+
+        for (int ty = 0; ty < tiles_y; ty++)
+            for (int tx = 0; tx < tiles_x; tx++)
+            {
+                pool.submit([&, tx, ty]
+                {
+                    size_t hits = 0;
+                    const int x1 = std::min(target.width, (tx + 1) * tile_size);
+                    const int y1 = std::min(target.height, (ty + 1) * tile_size);
+                    for (int y = ty * tile_size; y < y1; y++)
+                        for (int x = tx * tile_size; x < x1; x++)
+                        {
+                            // pixel centers in clip space, row 0 at the top
+                            const glm::vec3 clip{
+                                (static_cast<float>(x) + 0.5f) / static_cast<float>(target.width) * 2.f - 1.f,
+                                1.f - (static_cast<float>(y) + 0.5f) / static_cast<float>(target.height) * 2.f,
+                                near
+                            };
+
+                            // every pixel is written, a reused framebuffer keeps nothing of the last frame
+                            const size_t pixel = static_cast<size_t>(y) * target.width + x;
+                            RayQueryHit hit;
+                            if (!raycast(tree, {toModel(clip - translation), direction}, hit))
+                            {
+                                target.color[pixel] = target.background;
+                                target.depth[pixel] = std::numeric_limits<float>::infinity();
+                                continue;
+                            }
+
+                            const glm::vec3 position{clip.x, clip.y, near + hit.distance};
+                            const float d = glm::distance(lamp, position);
+                            target.color[pixel] = intensity / (d * d) * hit.color;
+                            target.depth[pixel] = position.z;
+                            hits++;
+                        }
+                    tile_hits[static_cast<size_t>(ty) * tiles_x + tx] = hits;
+                });
+            }
+        pool.wait();
+
+        if (!stats) return;
+        stats->rays = static_cast<size_t>(target.width) * target.height;
+        stats->hits = 0;
+        for (const size_t hits : tile_hits) stats->hits += hits;
+        stats->ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
@@ -0,0 +1,378 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <span>
+#include <stdexcept>
+#include <vector>
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include "voxel.hpp"
+#include "voxel_linearized.hpp"
+#include "async_build.hpp"
+#include "interfaces.hpp"
+
+namespace lin
+{
+    struct SceneModel
+    {
+        glm::mat4 transform{1.f};   // model cell [-0.5, 0.5] to scene space, before the scene's rotation
+        size_t first = 0;           // instance range in the scene's instance buffer
+        size_t count = 0;
+        bool visible = true;
+        bool removed = false;
+    };
+
+    // many models behind one program, one cube VAO and one instance buffer. every instance carries its model's
+    // index into a storage buffer of transforms, so the whole scene is one instanced draw; hidden models turn
+    // it into one multi-draw-indirect over the visible ranges. each model owns a range of the buffer, so adding
+    // or removing one only writes that range, freed ranges are zeroed and reused
+    class Scene final : public ctx::IRenderable
+    {
+    public:
+        // what the scene keeps per instance, all of it on the gpu
+        static constexpr size_t INSTANCE_BYTES = sizeof(PackedInstance) + sizeof(GLuint);
+
+    private:
+        struct Upload
+        {
+            size_t model;
+            std::vector<PackedInstance> packed;
+        };
+
+        std::vector<SceneModel> models;
+        std::vector<std::pair<size_t, size_t>> free_ranges;    // first and count, sorted and never adjacent
+        size_t used = 0;                                       // end of the last allocated range
+        size_t live = 0;
+
+        ctx::Program *glsl_program = nullptr;
+        GLuint model_vao = 0;
+        GLuint instance_vbo = 0;
+        GLuint model_vbo = 0;
+        GLuint transform_ssbo = 0;
+        GLuint indirect_buffer = 0;
+        size_t gpu_capacity = 0;
+        float radians = 0;
+
+        // packed on add, dropped once uploaded; freed ranges are cleared before uploads land in them
+        std::vector<Upload> uploads;
+        std::vector<std::pair<size_t, size_t>> clears;
+        std::vector<GLuint> indices;
+        std::vector<glm::mat4> transforms;
+        std::vector<DrawElementsIndirectCommand> commands;
+        bool transforms_dirty = true;
+        bool ranges_dirty = true;
+
+        SceneModel &get(size_t model);
+        size_t allocate(size_t count);
+        void release(size_t first, size_t count);
+        void bind_instances() const;
+        void grow();
+        void flush();
+
+    public:
+        Scene() = default;
+        // returns the model's id, ids stay valid until the model is removed and are reused after that
+        size_t add(const vox::Octree *layout, const glm::mat4 &transform = glm::mat4{1.f});
+        size_t add(std::span<const glm::vec3> _color, std::span<const GLuint64> _location, std::span<const GLint> _depth,
+                   const glm::mat4 &transform = glm::mat4{1.f});
+        void remove(size_t model);
+        void set_transform(size_t model, const glm::mat4 &transform);
+        void set_visible(size_t model, bool visible);
+        [[nodiscard]] size_t model_count() const;
+        [[nodiscard]] size_t instance_count() const;
+
+        void render() override;
+        void use_shader() override;
+        void pre_render() override;
+        void pre_render_cleanup() override;
+    };
+
+    inline SceneModel &Scene::get(const size_t model)
+    {
+        if (model >= models.size() || models[model].removed) throw std::runtime_error("Scene has no such model.");
+        return models[model];
+    }
+
+    // first fit over the freed ranges, else past the last range
+    inline size_t Scene::allocate(const size_t count)
+    {
+        for (auto it = free_ranges.begin(); it != free_ranges.end(); ++it)
+        {
+            if (it->second < count) continue;
+            const size_t first = it->first;
+            it->first += count;
+            it->second -= count;
+            if (!it->second) free_ranges.erase(it);
+            return first;
+        }
+        used += count;
+        return used - count;
+    }
+
+    // merges with its neighbours, a range ending at the tail gives the space back to it
+    inline void Scene::release(size_t first, size_t count)
+    {
+        if (!count) return;
+        clears.emplace_back(first, count);
+
+        auto next = std::lower_bound(free_ranges.begin(), free_ranges.end(), std::pair{first, size_t{0}});
+        if (next != free_ranges.begin() && std::prev(next)->first + std::prev(next)->second == first)
+        {
+            --next;
+            first = next->first;
+            count += next->second;
+            next = free_ranges.erase(next);
+        }
+        if (next != free_ranges.end() && first + count == next->first)
+        {
+            count += next->second;
+            next = free_ranges.erase(next);
+        }
+
+        if (first + count == used) used = first;
+        else free_ranges.insert(next, {first, count});
+    }
+
+    inline size_t Scene::add(const vox::Octree *layout, const glm::mat4 &transform)
+    {
+        vox::InstanceBatch batch;
+        vox::linearizeBatch(layout, 0, 0, batch);
+        return add(batch.color, batch.location, batch.level, transform);
+    }
+
+    inline size_t Scene::add(std::span<const glm::vec3> _color, std::span<const GLuint64> _location, std::span<const GLint> _depth,
+                             const glm::mat4 &transform)
+    {
+        // slots of removed models are reused so the transform buffer does not grow with churn
+        const auto reused = std::find_if(models.begin(), models.end(), [](const SceneModel &m) { return m.removed; });
+        const auto id = static_cast<size_t>(reused - models.begin());
+        if (reused == models.end()) models.emplace_back();
+        models[id] = {transform, allocate(_location.size()), _location.size(), true, false};
+        live += _location.size();
+
+        Upload upload{id, std::vector<PackedInstance>(_location.size())};
+        packInstances(_color, _location, _depth, nullptr, upload.packed);
+        uploads.push_back(std::move(upload));
+
+        transforms_dirty = ranges_dirty = true;
+        return id;
+    }
+
+    // the model's range is zeroed on the next flush and goes back to the allocator, nothing else moves
+    inline void Scene::remove(const size_t model)
+    {
+        SceneModel &removed = get(model);
+        std::erase_if(uploads, [model](const Upload &upload) { return upload.model == model; });
+        release(removed.first, removed.count);
+        live -= removed.count;
+        removed.count = 0;
+        removed.removed = true;
+        ranges_dirty = true;
+    }
+
+    inline void Scene::set_transform(const size_t model, const glm::mat4 &transform)
+    {
+        get(model).transform = transform;
+        transforms_dirty = true;
+    }
+
+    inline void Scene::set_visible(const size_t model, const bool visible)
+    {
+        get(model).visible = visible;
+        ranges_dirty = true;
+    }
+
+    inline size_t Scene::model_count() const
+    {
+        return static_cast<size_t>(std::count_if(models.begin(), models.end(), [](const SceneModel &m) { return !m.removed; }));
+    }
+
+    inline size_t Scene::instance_count() const
+    {
+        return live;
+    }
+
+    inline void Scene::bind_instances() const
+    {
+        glBindVertexArray(model_vao);
+        glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+        glEnableVertexAttribArray(5);
+        glVertexAttribIPointer(5, 1, GL_UNSIGNED_INT, sizeof(PackedInstance), reinterpret_cast<const void *>(offsetof(PackedInstance, color)));
+        glVertexAttribDivisor(5, 1);
+        glEnableVertexAttribArray(6);
+        glVertexAttribIPointer(6, 2, GL_UNSIGNED_INT, sizeof(PackedInstance), reinterpret_cast<const void *>(offsetof(PackedInstance, key_low)));
+        glVertexAttribDivisor(6, 1);
+
+        glBindBuffer(GL_ARRAY_BUFFER, model_vbo);
+        glEnableVertexAttribArray(7);
+        glVertexAttribIPointer(7, 1, GL_UNSIGNED_INT, sizeof(GLuint), nullptr);
+        glVertexAttribDivisor(7, 1);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // buffers grow by half, what is already on the gpu is copied over instead of sent again
+    inline void Scene::grow()
+    {
+        const size_t capacity = std::max<size_t>(used + used / 2, 1024);
+        for (const auto &[buffer, stride] : {std::pair{&instance_vbo, sizeof(PackedInstance)}, std::pair{&model_vbo, sizeof(GLuint)}})
+        {
+            GLuint grown = 0;
+            glGenBuffers(1, &grown);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+            glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(capacity * stride), nullptr, GL_DYNAMIC_DRAW);
+            // space nobody allocated yet reads as dead instances
+            glClearBufferData(GL_COPY_WRITE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+            if (*buffer && gpu_capacity)
+            {
+                glBindBuffer(GL_COPY_READ_BUFFER, *buffer);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, static_cast<GLsizeiptr>(gpu_capacity * stride));
+            }
+            glDeleteBuffers(1, buffer);
+            *buffer = grown;
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        gpu_capacity = capacity;
+        bind_instances();
+    }
+
+    // adds and removes write only their own ranges, a transform change is one small storage buffer write
+    inline void Scene::flush()
+    {
+        if (used > gpu_capacity) grow();
+
+        if (!clears.empty())
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+            for (const auto &[first, count] : clears)
+                glClearBufferSubData(GL_ARRAY_BUFFER, GL_R32UI, static_cast<GLintptr>(first * sizeof(PackedInstance)),
+                                     static_cast<GLsizeiptr>(count * sizeof(PackedInstance)), GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            clears.clear();
+        }
+
+        for (const Upload &upload : uploads)
+        {
+            const SceneModel &model = models[upload.model];
+            indices.assign(model.count, static_cast<GLuint>(upload.model));
+            glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+            glBufferSubData(GL_ARRAY_BUFFER, static_cast<GLintptr>(model.first * sizeof(PackedInstance)),
+                            static_cast<GLsizeiptr>(model.count * sizeof(PackedInstance)), upload.packed.data());
+            glBindBuffer(GL_ARRAY_BUFFER, model_vbo);
+            glBufferSubData(GL_ARRAY_BUFFER, static_cast<GLintptr>(model.first * sizeof(GLuint)),
+                            static_cast<GLsizeiptr>(model.count * sizeof(GLuint)), indices.data());
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        uploads.clear();
+
+        if (transforms_dirty)
+        {
+            transforms.resize(std::max<size_t>(models.size(), 1));
+            for (size_t i = 0; i < models.size(); i++) transforms[i] = models[i].transform;
+
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, transform_ssbo);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, transforms.size() * sizeof(glm::mat4), glm::value_ptr(transforms[0]), GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            transforms_dirty = false;
+        }
+
+        if (ranges_dirty)
+        {
+            // adjacent visible models merge into one range, nothing to do when every model is shown
+            commands.clear();
+            const bool all_visible = std::all_of(models.begin(), models.end(), [](const SceneModel &m) { return m.removed || m.visible; });
+            if (!all_visible)
+            {
+                std::vector<std::pair<size_t, size_t>> ranges;
+                for (const SceneModel &m : models)
+                {
+                    if (m.removed || !m.visible || !m.count) continue;
+                    ranges.emplace_back(m.first, m.count);
+                }
+                std::sort(ranges.begin(), ranges.end());
+
+                std::vector<std::pair<size_t, size_t>> merged;
+                for (const auto &range : ranges)
+                {
+                    if (!merged.empty() && merged.back().first + merged.back().second == range.first) merged.back().second += range.second;
+                    else merged.push_back(range);
+                }
+
+                for (const GLuint first_index : {0u, 8u})
+                    for (const auto &[first, count] : merged)
+                        commands.push_back({8, static_cast<GLuint>(count), first_index, 0, static_cast<GLuint>(first)});
+
+                if (!indirect_buffer) glGenBuffers(1, &indirect_buffer);
+                glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_buffer);
+                glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_DYNAMIC_DRAW);
+                glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+            }
+            else if (indirect_buffer)
+            {
+                glDeleteBuffers(1, &indirect_buffer);
+                indirect_buffer = 0;
+            }
+            ranges_dirty = false;
+        }
+    }
+
+    inline void Scene::use_shader()
+    {
+        glsl_program->use();
+    }
+
+    inline void Scene::pre_render()
+    {
+        glsl_program = ctx::makeProgram({"scene.vert", "voxel.frag"});
+        glsl_program->use();
+
+        model_vao = vox::preDrawCube();
+
+        glGenBuffers(1, &transform_ssbo);
+        grow();
+        flush();
+    }
+
+    inline void Scene::render()
+    {
+        radians += 0.01;
+        if (radians >= glm::two_pi<float>()) radians = 0;
+        glProgramUniform1f(glsl_program->get_id(), 1, radians);
+
+        flush();
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, transform_ssbo);
+        glBindVertexArray(model_vao);
+
+        if (indirect_buffer)
+        {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_buffer);
+            glMultiDrawElementsIndirect(GL_TRIANGLE_FAN, GL_UNSIGNED_INT, nullptr, static_cast<GLsizei>(commands.size()), 0);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+            return;
+        }
+
+        glDrawElementsInstanced(
+            GL_TRIANGLE_FAN,
+            8, GL_UNSIGNED_INT,
+            nullptr, static_cast<GLsizei>(used)
+        );
+        glDrawElementsInstanced(
+            GL_TRIANGLE_FAN,
+            8, GL_UNSIGNED_INT,
+            reinterpret_cast<const void *>(8 * sizeof(float)), static_cast<GLsizei>(used)
+        );
+    }
+
+    inline void Scene::pre_render_cleanup()
+    {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glClearColor(1.0,1.0,1.0,1.0);
+        glEnable(GL_DEPTH_TEST);
+        glDepthFunc(GL_LESS);
+        glFrontFace(GL_CW);
+        glEnable(GL_CULL_FACE);
+        glCullFace(GL_BACK);
+    }
+}
@@ -1,47 +1,114 @@
 #pragma once
 
-#include <string>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
 #include <fstream>
+#include <iterator>
+#include <initializer_list>
+#include <iostream>
 #include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 #include <GL/glew.h>
 
+// generated into the build tree from shaders/ by cmake/embed_shaders.cmake; builds without it read the
+// files from VOXELS_SHADER_DIR instead
+#if __has_include("embedded_shaders.hpp")
+#include "embedded_shaders.hpp"
+#define VOXELS_EMBEDDED_SHADERS 1
+#endif
+
+#ifndef VOXELS_SHADER_DIR
+#define VOXELS_SHADER_DIR "shaders"
+#endif
+
 namespace ctx
 {
+    struct ShaderSource
+    {
+        std::string name;
+        GLenum type;
+        std::string source;
+    };
+
+    inline ShaderSource shaderFile(const std::string &path, const GLenum type)
+    {
+        std::ifstream file(path);
+        if (!file) throw std::runtime_error("[OpenGL] Could not open shader: " + path);
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        return {path, type, buffer.str()};
+    }
+
+    // embedded source of shaders/<name> with its includes resolved, the stage follows from the extension
+    inline ShaderSource shaderSource(const std::string_view name)
+    {
+        GLenum type;
+        if (name.ends_with(".vert")) type = GL_VERTEX_SHADER;
+        else if (name.ends_with(".frag")) type = GL_FRAGMENT_SHADER;
+        else throw std::runtime_error("[OpenGL] Unknown shader stage: " + std::string(name));
+
+#ifdef VOXELS_EMBEDDED_SHADERS
+        for (const EmbeddedShader &shader : EMBEDDED_SHADERS)
+            if (shader.name == name) return {std::string(name), type, std::string(shader.source)};
+        throw std::runtime_error("[OpenGL] Shader not embedded: " + std::string(name));
+#else
+        // #include "<file>" lines pull in a file from the same directory, one level deep, as embedding does
+        const std::string directory = VOXELS_SHADER_DIR;
+        std::istringstream lines(shaderFile(directory + "/" + std::string(name), type).source);
+        std::string source;
+        for (std::string line; std::getline(lines, line);)
+        {
+            constexpr std::string_view directive = "#include \"";
+            if (line.starts_with(directive) && line.size() > directive.size() && line.back() == '"')
+                line = shaderFile(directory + "/" + line.substr(directive.size(), line.size() - directive.size() - 1), type).source;
+            source += line + "\n";
+        }
+        return {std::string(name), type, std::move(source)};
+#endif
+    }
 
     class Shader
     {
         GLuint shader_id = 0;
     public:
+        explicit Shader(const ShaderSource &source);
         Shader(const std::string& shader_path, GLenum shader_type);
         ~Shader();
+        Shader(const Shader &) = delete;
+        Shader &operator=(const Shader &) = delete;
         [[nodiscard]] GLuint get_id() const;
     };
 
-    inline Shader::Shader(const std::string& shader_path, const GLenum shader_type)
+    inline Shader::Shader(const ShaderSource &source)
     {
-        std::ifstream shader_file;
-        shader_file.open(shader_path);
-
-        std::stringstream buffer;
-        buffer << shader_file.rdbuf();
-        std::string content = buffer.str();
-        std::cout << content << std::endl;
-        shader_id = glCreateShader(shader_type);
-        glShaderSource(shader_id, 1, reinterpret_cast<GLchar * const *>(&content), nullptr);
+        const GLchar *content = source.source.c_str();
+        shader_id = glCreateShader(source.type);
+        glShaderSource(shader_id, 1, &content, nullptr);
         glCompileShader(shader_id);
 
         GLint log_size = 0;
         glGetShaderiv(shader_id, GL_INFO_LOG_LENGTH, &log_size);
+        std::string log(std::max(log_size, 1), '\0');
+        if (log_size > 1)
+        {
+            glGetShaderInfoLog(shader_id, log_size, nullptr, log.data());
+            std::cerr << "[OpenGL shader log] " << source.name << ": " << log << std::endl;
+        }
 
-        char log[log_size] = {'\0'};
-        glGetShaderInfoLog(shader_id, log_size, nullptr, log);
-        std::cerr << "[OpenGL shader log] " << log << std::endl;
-
-        if (shader_id == GL_INVALID_VALUE)
-            throw std::runtime_error("[OpenGL] Panic on shader compilation.");
-
+        GLint compiled = GL_FALSE;
+        glGetShaderiv(shader_id, GL_COMPILE_STATUS, &compiled);
+        if (!compiled) throw std::runtime_error("[OpenGL] Panic on shader compilation: " + source.name);
+    }
 
-        shader_file.close();
+    inline Shader::Shader(const std::string& shader_path, const GLenum shader_type)
+        : Shader(shaderFile(shader_path, shader_type))
+    {
     }
 
     inline Shader::~Shader()
@@ -62,8 +129,11 @@ namespace ctx
     public:
         explicit Program();
         ~Program();
-        void attach(Shader shader) const;
+        void attach(const Shader &shader) const;
         void link();
+        // false when the driver rejects the binary, the program can still be attached and linked afterwards
+        bool load_binary(const std::filesystem::path &path);
+        void save_binary(const std::filesystem::path &path) const;
         void use() const;
         [[nodiscard]] GLuint get_id() const;
     };
@@ -95,7 +165,7 @@ namespace ctx
     }
 
 
-    inline void Program::attach(Shader shader) const
+    inline void Program::attach(const Shader &shader) const
     {
         if (!linked)
         {
@@ -107,10 +177,120 @@ namespace ctx
     {
         glLinkProgram(program_id);
         linked = true;
+
+        GLint status = GL_FALSE;
+        glGetProgramiv(program_id, GL_LINK_STATUS, &status);
+        if (status) return;
+
+        GLint log_size = 0;
+        glGetProgramiv(program_id, GL_INFO_LOG_LENGTH, &log_size);
+        std::string log(std::max(log_size, 1), '\0');
+        glGetProgramInfoLog(program_id, log_size, nullptr, log.data());
+        throw std::runtime_error("[OpenGL] Program did not link: " + log);
+    }
+
+    // cache file: magic, binary format, then the driver's binary
+    constexpr char PROGRAM_CACHE_MAGIC[4] = {'V', 'O', 'X', 'P'};
+
+    inline bool Program::load_binary(const std::filesystem::path &path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) return false;
+
+        char magic[4] = {};
+        GLenum format = 0;
+        file.read(magic, 4);
+        file.read(reinterpret_cast<char *>(&format), sizeof(format));
+        if (!file || std::string_view(magic, 4) != std::string_view(PROGRAM_CACHE_MAGIC, 4)) return false;
+        const std::vector<char> binary{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+        if (binary.empty()) return false;
+
+        glProgramBinary(program_id, format, binary.data(), static_cast<GLsizei>(binary.size()));
+        GLint status = GL_FALSE;
+        glGetProgramiv(program_id, GL_LINK_STATUS, &status);
+        linked = status == GL_TRUE;
+        return linked;
+    }
+
+    // written next to the target and renamed over it, so a concurrent start never reads half a binary
+    inline void Program::save_binary(const std::filesystem::path &path) const
+    {
+        GLint length = 0;
+        glGetProgramiv(program_id, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) return;
+
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(program_id, length, nullptr, &format, binary.data());
+
+        std::error_code error;
+        std::filesystem::create_directories(path.parent_path(), error);
+        const std::filesystem::path temporary = path.string() + ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            file.write(PROGRAM_CACHE_MAGIC, 4);
+            file.write(reinterpret_cast<const char *>(&format), sizeof(format));
+            file.write(binary.data(), length);
+            if (!file) return;
+        }
+        std::filesystem::rename(temporary, path, error);
     }
 
     inline void Program::use() const
     {
         glUseProgram(program_id);
     }
+
+    // $VOXELS_SHADER_CACHE, else the XDG cache directory; empty turns the cache off
+    inline std::filesystem::path programCacheDirectory()
+    {
+        if (const char *dir = std::getenv("VOXELS_SHADER_CACHE")) return dir;
+        if (const char *dir = std::getenv("XDG_CACHE_HOME"); dir && *dir) return std::filesystem::path(dir) / "voxels";
+        if (const char *home = std::getenv("HOME"); home && *home) return std::filesystem::path(home) / ".cache" / "voxels";
+        return {};
+    }
+
+    inline uint64_t fnv1a(const std::string_view data, uint64_t hash = 14695981039346656037ull)
+    {
+        for (const char c : data)
+        {
+            hash ^= static_cast<uint8_t>(c);
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // links the named shaders, skipping compilation when the binary cache has this exact program for this
+    // driver. the key hashes vendor, renderer, driver version and every source, so an updated driver or an
+    // edited shader misses instead of loading a stale binary; one the driver rejects anyway is rebuilt
+    inline Program *makeProgram(const std::initializer_list<std::string_view> names)
+    {
+        std::vector<ShaderSource> sources;
+        for (const std::string_view name : names) sources.push_back(shaderSource(name));
+
+        uint64_t key = fnv1a("voxels program cache 1");
+        for (const GLenum info : {GL_VENDOR, GL_RENDERER, GL_VERSION})
+            if (const auto *text = reinterpret_cast<const char *>(glGetString(info))) key = fnv1a(text, key);
+        for (const ShaderSource &source : sources)
+        {
+            key = fnv1a(source.name, key);
+            key = fnv1a(source.source, key);
+        }
+
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        const std::filesystem::path directory = formats > 0 ? programCacheDirectory() : std::filesystem::path{};
+        std::ostringstream file_name;
+        file_name << std::hex << key << ".bin";
+        const std::filesystem::path path = directory / file_name.str();
+
+        auto *program = new Program();
+        if (!directory.empty() && program->load_binary(path)) return program;
+
+        for (const ShaderSource &source : sources) program->attach(Shader(source));
+        if (!directory.empty()) glProgramParameteri(program->get_id(), GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        program->link();
+        if (!directory.empty()) program->save_binary(path);
+        return program;
+    }
 }
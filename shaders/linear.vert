@@ -2,60 +2,41 @@
 
 layout(location = 0) in vec3 position;
 layout(location = 1) uniform float angle;
+// 0: aColor is rgb8, otherwise the number of palette entries aColor indexes
+layout(location = 2) uniform int palette_size;
 
 layout(location = 3) uniform float model_scale;
 layout(location = 4) uniform vec3 model_offset;
 
-layout(location = 5) in vec3 aColor;
-layout(location = 6) in int aId;
-layout(location = 7) in int aDepth;
+// rgb in xyz. a storage buffer, 256 vec3 uniforms would take the whole default block drivers have to offer
+layout(std430, binding = 1) readonly buffer Palette
+{
+    vec4 palette[];
+};
 
+layout(location = 5) in uint aColor;
+// octant path with a marker bit above its top digit, (low, high)
+layout(location = 6) in uvec2 aKey;
 
-vec3 DCENTERS[8] = {
-    vec3(1, 1, 1),
-    vec3(-1, 1, 1),
-    vec3(-1, -1, 1),
-    vec3(1, -1, 1), // upper
-    vec3(1, 1, -1),
-    vec3(-1, 1, -1),
-    vec3(-1, -1, -1),
-    vec3(1, -1, -1)
-};
 
 out vec4 vertColor;
 
-vec3 compute_octant_offset(int id, int depth)
-{
-    vec3 offset = vec3(0, 0, 0);
-    if (depth == 0) return offset;
-    float n = 0.25;
-    for (int i = 0; i < depth; i++)
+#include "octree_key.glsl"
+
+void main() {
+    // dead instances are slots freed by an edit
+    int aDepth;
+    uvec2 aId;
+    if (!decode_key(aKey, aDepth, aId))
     {
-        offset += n * DCENTERS[id % 8];
-        n /= 2;
-        id /= 8;
+        gl_Position = vec4(0, 0, 2, 1);
+        vertColor = vec4(0);
+        return;
     }
 
-    return offset;
-}
-
-mat4 rotation3d(vec3 axis, float angle)
-{
-    axis = normalize(axis);
-    float s = sin(angle);
-    float c = cos(angle);
-    float oc = 1.0 - c;
-
-    return mat4(
-    oc * axis.x * axis.x + c,           oc * axis.x * axis.y - axis.z * s,  oc * axis.z * axis.x + axis.y * s,  0.0,
-    oc * axis.x * axis.y + axis.z * s,  oc * axis.y * axis.y + c,           oc * axis.y * axis.z - axis.x * s,  0.0,
-    oc * axis.z * axis.x - axis.y * s,  oc * axis.y * axis.z + axis.x * s,  oc * axis.z * axis.z + c,           0.0,
-    0.0,                                0.0,                                0.0,                                1.0
-    );
-}
-
-void main() {
     //    vec3 lamp = vec3(0, 20, -100);
+    vec3 color = palette_size > 0 ? palette[min(int(aColor), palette_size - 1)].rgb : unpackUnorm4x8(aColor).rgb;
+
     vec3 lamp = vec3(0, 1, -1);
     vec3 intensity = vec3(1.2);
     vec3 posi = position * pow(0.5, aDepth + 1) + compute_octant_offset(aId, aDepth);
@@ -66,5 +47,5 @@ void main() {
     vec3 lamp_dir = normalize(lamp - pos4.xyz);
     //    vec3 strength = intensity * dot(lamp_dir, pos4.xyz) / distance(lamp, pos4.xyz);
     vec3 strength = intensity / (distance(lamp, pos4.xyz) * distance(lamp, pos4.xyz));
-    vertColor = vec4(strength * aColor, 1.0);
+    vertColor = vec4(strength * color, 1.0);
 }
@@ -0,0 +1,36 @@
+#version 450
+
+layout(location = 0) in vec3 position;
+layout(location = 1) uniform float angle;
+
+layout(location = 3) uniform float model_scale;
+layout(location = 4) uniform vec3 model_offset;
+
+layout(location = 5) in vec3 aColor;
+
+out vec4 vertColor;
+
+mat4 rotation3d(vec3 axis, float angle)
+{
+    axis = normalize(axis);
+    float s = sin(angle);
+    float c = cos(angle);
+    float oc = 1.0 - c;
+
+    return mat4(
+    oc * axis.x * axis.x + c,           oc * axis.x * axis.y - axis.z * s,  oc * axis.z * axis.x + axis.y * s,  0.0,
+    oc * axis.x * axis.y + axis.z * s,  oc * axis.y * axis.y + c,           oc * axis.y * axis.z - axis.x * s,  0.0,
+    oc * axis.z * axis.x - axis.y * s,  oc * axis.y * axis.z + axis.x * s,  oc * axis.z * axis.z + c,           0.0,
+    0.0,                                0.0,                                0.0,                                1.0
+    );
+}
+
+void main() {
+    vec3 lamp = vec3(0, 1, -1);
+    vec3 intensity = vec3(1.2);
+    vec4 pos4 = vec4(position, 1.);
+    pos4 = rotation3d(vec3(0.0, 1.0, -0.2), angle) * pos4;
+    gl_Position = pos4;
+    vec3 strength = intensity / (distance(lamp, pos4.xyz) * distance(lamp, pos4.xyz));
+    vertColor = vec4(strength * aColor, 1.0);
+}
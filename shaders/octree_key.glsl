@@ -0,0 +1,54 @@
+// octree key decode shared by linear.vert and scene.vert. their include line is replaced with this file
+// by cmake/embed_shaders.cmake, or by ctx::shaderSource when shaders are read at run time
+
+vec3 DCENTERS[8] = {
+    vec3(1, 1, 1),
+    vec3(-1, 1, 1),
+    vec3(-1, -1, 1),
+    vec3(1, -1, 1), // upper
+    vec3(1, 1, -1),
+    vec3(-1, 1, -1),
+    vec3(-1, -1, -1),
+    vec3(1, -1, -1)
+};
+
+// id is the 64 bit octant path (low, high), level 1 in the lowest 3 bits; the path is resolved
+// to integer cell coordinates first so that depths up to 21 keep full precision
+vec3 compute_octant_offset(uvec2 id, int depth)
+{
+    if (depth == 0) return vec3(0, 0, 0);
+    uvec3 cell = uvec3(0);
+    for (int i = 0; i < depth; i++)
+    {
+        uvec3 positive = uvec3(greaterThan(DCENTERS[id.x & 7u], vec3(0)));
+        cell |= positive << uint(depth - 1 - i);
+        id = uvec2((id.x >> 3) | (id.y << 29), id.y >> 3);
+    }
+
+    return (vec3(cell) + 0.5) / float(1u << uint(depth)) - 0.5;
+}
+
+mat4 rotation3d(vec3 axis, float angle)
+{
+    axis = normalize(axis);
+    float s = sin(angle);
+    float c = cos(angle);
+    float oc = 1.0 - c;
+
+    return mat4(
+    oc * axis.x * axis.x + c,           oc * axis.x * axis.y - axis.z * s,  oc * axis.z * axis.x + axis.y * s,  0.0,
+    oc * axis.x * axis.y + axis.z * s,  oc * axis.y * axis.y + c,           oc * axis.y * axis.z - axis.x * s,  0.0,
+    oc * axis.z * axis.x - axis.y * s,  oc * axis.y * axis.z + axis.x * s,  oc * axis.z * axis.z + c,           0.0,
+    0.0,                                0.0,                                0.0,                                1.0
+    );
+}
+
+// the marker sits at bit 3 * depth above the path. a key without one is a dead instance, false is returned
+bool decode_key(uvec2 key, out int depth, out uvec2 id)
+{
+    int marker = key.y != 0u ? 32 + findMSB(key.y) : findMSB(key.x);
+    if (marker < 0) return false;
+    depth = marker / 3;
+    id = marker >= 32 ? uvec2(key.x, key.y & ~(1u << uint(marker - 32))) : uvec2(key.x & ~(1u << uint(marker)), 0u);
+    return true;
+}
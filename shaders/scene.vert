@@ -0,0 +1,43 @@
+#version 450
+
+layout(location = 0) in vec3 position;
+layout(location = 1) uniform float angle;
+
+layout(location = 5) in uint aColor;
+// octant path with a marker bit above its top digit, (low, high)
+layout(location = 6) in uvec2 aKey;
+// index into models, the transform placing this instance's model in the scene
+layout(location = 7) in uint aModel;
+
+layout(std430, binding = 0) readonly buffer Models
+{
+    mat4 models[];
+};
+
+out vec4 vertColor;
+
+#include "octree_key.glsl"
+
+void main() {
+    // dead instances are ranges of removed models and space no model owns yet
+    int aDepth;
+    uvec2 aId;
+    if (!decode_key(aKey, aDepth, aId))
+    {
+        gl_Position = vec4(0, 0, 2, 1);
+        vertColor = vec4(0);
+        return;
+    }
+
+    vec3 color = unpackUnorm4x8(aColor).rgb;
+
+    vec3 lamp = vec3(0, 1, -1);
+    vec3 intensity = vec3(1.2);
+    vec3 posi = position * pow(0.5, aDepth + 1) + compute_octant_offset(aId, aDepth);
+    vec4 pos4 = models[aModel] * vec4(posi, 1.);
+    pos4 = rotation3d(vec3(0.0, 1.0, -0.2), angle) * pos4;
+    gl_Position = pos4;
+    vec3 lamp_dir = normalize(lamp - pos4.xyz);
+    vec3 strength = intensity / (distance(lamp, pos4.xyz) * distance(lamp, pos4.xyz));
+    vertColor = vec4(strength * color, 1.0);
+}
@@ -9,7 +9,7 @@ layout(location = 4) uniform vec3 model_offset;
 layout(location = 5) uniform float norm;
 layout(location = 6) uniform vec3 color;
 layout(location = 7) uniform int depth;
-layout(location = 8) uniform int[10] octants;
+layout(location = 8) uniform int[22] octants;
 
 vec3 DCENTERS[8] = {
     vec3(1, 1, 1),
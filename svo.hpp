@@ -0,0 +1,232 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include <glm/vec3.hpp>
+#include "voxel.hpp"
+
+namespace vox
+{
+    // inner node of a pointerless sparse voxel octree; children are stored breadth first, so all
+    // inner children of a node are adjacent in the node array and all leaf children in the leaf array
+    struct SvoNode
+    {
+        uint32_t first_child = 0;   // index of the first inner child in nodes
+        uint32_t first_leaf = 0;    // index of the first leaf child in leaves
+        uint8_t valid_mask = 0;     // bit i set: child i is not empty
+        uint8_t leaf_mask = 0;      // bit i set: child i is a leaf
+    };
+
+    // read-only view of the node and leaf arrays, either owned by an Svo or mapped from a file
+    struct SvoView
+    {
+        EOctant root = OCTANT_EMPTY;
+        std::span<const SvoNode> nodes;
+        std::span<const glm::vec3> leaves;
+    };
+
+    class Svo
+    {
+        std::vector<SvoNode> nodes;
+        std::vector<glm::vec3> leaves;
+        EOctant root = OCTANT_EMPTY;
+
+    public:
+        Svo() = default;
+        explicit Svo(const Octree *tree);
+
+        [[nodiscard]] EOctant get_root() const;
+        [[nodiscard]] const std::vector<SvoNode> &get_nodes() const;
+        [[nodiscard]] const std::vector<glm::vec3> &get_leaves() const;
+        [[nodiscard]] SvoView view() const;
+        [[nodiscard]] static uint32_t child_index(const SvoNode &node, int octant);
+        [[nodiscard]] static uint32_t leaf_index(const SvoNode &node, int octant);
+
+        void cull();
+        [[nodiscard]] int node_count() const;
+        [[nodiscard]] size_t bytes() const;
+    };
+
+    inline Svo::Svo(const Octree *tree)
+    {
+        if (tree->empty()) return;
+        if (tree->leaf())
+        {
+            root = OCTANT_LEAF;
+            leaves.push_back(tree->get_color());
+            return;
+        }
+
+        // nodes doubles as the breadth first queue
+        root = OCTANT_NODE;
+        std::vector<const Octree *> queue{tree};
+        nodes.emplace_back();
+
+        for (size_t k = 0; k < queue.size(); k++)
+        {
+            SvoNode node{};
+            node.first_child = static_cast<uint32_t>(nodes.size());
+            node.first_leaf = static_cast<uint32_t>(leaves.size());
+
+            const auto children = queue[k]->get_children();
+            for (int i = 0; i < 8; i++)
+            {
+                if (children[i]->empty()) continue;
+
+                node.valid_mask |= 1 << i;
+                if (children[i]->leaf())
+                {
+                    node.leaf_mask |= 1 << i;
+                    leaves.push_back(children[i]->get_color());
+                    continue;
+                }
+
+                queue.push_back(children[i]);
+                nodes.emplace_back();
+            }
+
+            nodes[k] = node;
+        }
+    }
+
+    inline EOctant Svo::get_root() const
+    {
+        return root;
+    }
+
+    inline const std::vector<SvoNode> &Svo::get_nodes() const
+    {
+        return nodes;
+    }
+
+    inline const std::vector<glm::vec3> &Svo::get_leaves() const
+    {
+        return leaves;
+    }
+
+    inline SvoView Svo::view() const
+    {
+        return {root, nodes, leaves};
+    }
+
+    inline uint32_t Svo::child_index(const SvoNode &node, const int octant)
+    {
+        const uint8_t inner_mask = node.valid_mask & ~node.leaf_mask;
+        return node.first_child + std::popcount(static_cast<uint8_t>(inner_mask & ((1 << octant) - 1)));
+    }
+
+    inline uint32_t Svo::leaf_index(const SvoNode &node, const int octant)
+    {
+        return node.first_leaf + std::popcount(static_cast<uint8_t>(node.leaf_mask & ((1 << octant) - 1)));
+    }
+
+    inline void Svo::cull()
+    {
+        if (root != OCTANT_NODE) return;
+
+        // children always come after their parent, so a reverse sweep sees them collapsed first
+        std::vector<EOctant> state(nodes.size(), OCTANT_NODE);
+        std::vector<glm::vec3> color(nodes.size());
+
+        for (size_t k = nodes.size(); k-- > 0;)
+        {
+            const SvoNode &node = nodes[k];
+            std::array<EOctant, 8> slots{};
+            std::array<glm::vec3, 8> colors{};
+
+            for (int i = 0; i < 8; i++)
+            {
+                if (!(node.valid_mask >> i & 1)) slots[i] = OCTANT_EMPTY;
+                else if (node.leaf_mask >> i & 1)
+                {
+                    slots[i] = OCTANT_LEAF;
+                    colors[i] = leaves[leaf_index(node, i)];
+                }
+                else
+                {
+                    slots[i] = state[child_index(node, i)];
+                    colors[i] = color[child_index(node, i)];
+                }
+            }
+
+            bool uniform = slots[0] != OCTANT_NODE;
+            for (int i = 1; i < 8 && uniform; i++)
+                uniform = slots[i] == slots[0] && (slots[0] == OCTANT_EMPTY || colors[i] == colors[0]);
+
+            if (!uniform) continue;
+            state[k] = slots[0];
+            color[k] = colors[0];
+        }
+
+        if (state[0] != OCTANT_NODE)
+        {
+            root = state[0];
+            leaves = root == OCTANT_LEAF ? std::vector{color[0]} : std::vector<glm::vec3>{};
+            nodes.clear();
+            return;
+        }
+
+        // re-emit the surviving nodes breadth first
+        std::vector<SvoNode> culled_nodes{SvoNode{}};
+        std::vector<glm::vec3> culled_leaves;
+        std::vector<uint32_t> queue{0};
+
+        for (size_t k = 0; k < queue.size(); k++)
+        {
+            const SvoNode &old_node = nodes[queue[k]];
+            SvoNode node{};
+            node.first_child = static_cast<uint32_t>(culled_nodes.size());
+            node.first_leaf = static_cast<uint32_t>(culled_leaves.size());
+
+            for (int i = 0; i < 8; i++)
+            {
+                if (!(old_node.valid_mask >> i & 1)) continue;
+
+                if (old_node.leaf_mask >> i & 1)
+                {
+                    node.valid_mask |= 1 << i;
+                    node.leaf_mask |= 1 << i;
+                    culled_leaves.push_back(leaves[leaf_index(old_node, i)]);
+                    continue;
+                }
+
+                const uint32_t child = child_index(old_node, i);
+                switch (state[child])
+                {
+                    case OCTANT_EMPTY:
+                        break;
+                    case OCTANT_LEAF:
+                        node.valid_mask |= 1 << i;
+                        node.leaf_mask |= 1 << i;
+                        culled_leaves.push_back(color[child]);
+                        break;
+                    case OCTANT_NODE:
+                        node.valid_mask |= 1 << i;
+                        queue.push_back(child);
+                        culled_nodes.emplace_back();
+                        break;
+                }
+            }
+
+            culled_nodes[k] = node;
+        }
+
+        nodes.swap(culled_nodes);
+        leaves.swap(culled_leaves);
+    }
+
+    inline int Svo::node_count() const
+    {
+        // every inner node has 8 children, matching Octree::node_count
+        if (root != OCTANT_NODE) return 1;
+        return static_cast<int>(nodes.size()) * 8 + 1;
+    }
+
+    inline size_t Svo::bytes() const
+    {
+        return nodes.size() * sizeof(SvoNode) + leaves.size() * sizeof(glm::vec3);
+    }
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <array>
+#include <stdexcept>
 #include <glm/vec3.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include "interfaces.hpp"
@@ -8,6 +9,9 @@
 
 namespace vox
 {
+	// deepest level reachable through 64 bit octant paths and the octant arrays in the shaders
+	constexpr int MAX_DEPTH = 21;
+
 	static float CUBE_VERTICES[24] = {
 		1.f, 1.f, 1.f,
 		-1.f, 1.f, 1.f,
@@ -98,6 +102,11 @@ namespace vox
 		[[nodiscard]] bool node() const;
 		void draw(GLuint vao, int *octants, int depth, float norm, ctx::Program *program) const;
 		void cull();
+		bool collapse();
+		void make_leaf(glm::vec3 _colorRGB);
+		void make_empty();
+		void make_node();
+		void set_child(int i, Octree *child);
 		void print() const;
 		[[nodiscard]] int node_count() const;
 
@@ -107,11 +116,11 @@ namespace vox
 
 	inline Octree::~Octree()
 	{
+		// heap built trees own their children, arena nodes are never destructed
 		for (int i = 0; i < 8; i++)
 		{
 			delete children[i];
 		}
-		delete this;
 	}
 
 	inline Octree::Octree()
@@ -177,24 +186,58 @@ namespace vox
 		// cull children
 		for (int i = 0; i < 8; i++) children[i]->cull();
 
+		collapse();
+	}
+
+	// merges eight equal leaf or empty children into this node, children stay owned by it
+	inline bool Octree::collapse()
+	{
+		if (octant != OCTANT_NODE) return false;
+
 		// skip un-cullable nodes
 		for (int i = 0; i < 8; i++)
-			if (!children[i]->leaf()) return;
+			if (children[i]->node()) return false;
 
 		if (children[0]->empty())
 		{
-			for (int i = 1; i < 8; i++) if (!children[i]->empty()) return;
+			for (int i = 1; i < 8; i++) if (!children[i]->empty()) return false;
 
 			octant = OCTANT_EMPTY;
-			return;
+			return true;
 		}
 
 		const glm::vec3 color = children[0]->colorRGB;
 		for (int i = 1; i < 8; i++)
-			if (color != children[i]->colorRGB) return;
+			if (!children[i]->leaf() || color != children[i]->colorRGB) return false;
 
 		octant = OCTANT_LEAF;
 		colorRGB = color;
+		return true;
+	}
+
+	// the make_ functions only retag the node, children are kept like after a collapse
+	inline void Octree::make_leaf(const glm::vec3 _colorRGB)
+	{
+		octant = OCTANT_LEAF;
+		colorRGB = _colorRGB;
+	}
+
+	inline void Octree::make_empty()
+	{
+		octant = OCTANT_EMPTY;
+	}
+
+	inline void Octree::make_node()
+	{
+		for (int i = 0; i < 8; i++)
+			if (!children[i]) throw std::runtime_error("Octree node needs all eight children.");
+		octant = OCTANT_NODE;
+	}
+
+	inline void Octree::set_child(const int i, Octree *child)
+	{
+		if (children[i]) throw std::runtime_error("Octree child slot already taken.");
+		children[i] = child;
 	}
 
 	inline int Octree::node_count() const
@@ -267,7 +310,7 @@ namespace vox
 		glProgramUniform1f(glsl_program->get_id(), 3, model_scale);
 		glProgramUniform3fv(glsl_program->get_id(), 4, 1, glm::value_ptr(model_offset));
 
-		int octants[10] = {};
+		int octants[MAX_DEPTH + 1] = {};
 		layout->draw(model_vao, octants, 0, 0.5, glsl_program);
 	}
 
@@ -279,19 +322,7 @@ namespace vox
 
 	inline void Voxel::pre_render()
 	{
-		glsl_program = new ctx::Program();
-		const ctx::Shader glsl_vertex_s(
-			"/home/lukas/projects/voxels/shaders/voxel.vert",
-			GL_VERTEX_SHADER
-		);
-		const ctx::Shader glsl_fragment_s(
-			"/home/lukas/projects/voxels/shaders/voxel.frag",
-			GL_FRAGMENT_SHADER
-		);
-
-		glsl_program->attach(glsl_vertex_s);
-		glsl_program->attach(glsl_fragment_s);
-		glsl_program->link();
+		glsl_program = ctx::makeProgram({"voxel.vert", "voxel.frag"});
 		glsl_program->use();
 
 		model_vao = preDrawCube();
@@ -1,8 +1,23 @@
 #pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <exception>
 #include <vector>
+#include <span>
+#include <memory>
+#include <thread>
 #include <iostream>
 #include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
 #include "voxel.hpp"
+#include "svo.hpp"
+#include "cull.hpp"
+#include "edit.hpp"
+#include "lod.hpp"
+#include "palette.hpp"
+#include "async_build.hpp"
 #include "interfaces.hpp"
 
 namespace lin
@@ -29,6 +44,67 @@ namespace lin
         );
     }
 
+    // same rotation linear.vert applies, the shaders have no other transform
+    inline glm::mat4 modelRotation(const float angle)
+    {
+        const glm::vec3 axis = glm::normalize(glm::vec3{0.0, 1.0, -0.2});
+        const float s = std::sin(angle);
+        const float c = std::cos(angle);
+        const float oc = 1.f - c;
+
+        return glm::mat4(
+            oc * axis.x * axis.x + c,           oc * axis.x * axis.y - axis.z * s,  oc * axis.z * axis.x + axis.y * s,  0.0,
+            oc * axis.x * axis.y + axis.z * s,  oc * axis.y * axis.y + c,           oc * axis.y * axis.z - axis.x * s,  0.0,
+            oc * axis.z * axis.x - axis.y * s,  oc * axis.y * axis.z + axis.x * s,  oc * axis.z * axis.z + c,           0.0,
+            0.0,                                0.0,                                0.0,                                1.0
+        );
+    }
+
+    // layout glMultiDrawElementsIndirect reads
+    struct DrawElementsIndirectCommand
+    {
+        GLuint count;
+        GLuint instance_count;
+        GLuint first_index;
+        GLint base_vertex;
+        GLuint base_instance;
+    };
+
+    // 12 byte interleaved instance LinVox uploads: the location with a marker bit above its top digit,
+    // so the depth is implied by the highest set bit (21 levels still fit in 64 bits), then the color as
+    // rgb8 or as a palette index. dead instances have no marker, the key is 0
+    struct PackedInstance
+    {
+        GLuint key_low;
+        GLuint key_high;
+        GLuint color;
+    };
+    static_assert(sizeof(PackedInstance) == 12);
+
+    inline GLuint64 packKey(const GLuint64 location, const GLint depth)
+    {
+        return depth < 0 ? 0 : location | static_cast<GLuint64>(1) << 3 * depth;
+    }
+
+    inline GLuint packRgb8(const glm::vec3 color)
+    {
+        const auto q = [](const float c) { return static_cast<GLuint>(std::lround(std::clamp(c, 0.f, 1.f) * 255.f)); };
+        return q(color.r) | q(color.g) << 8 | q(color.b) << 16;
+    }
+
+    inline void packInstances(std::span<const glm::vec3> color, std::span<const GLuint64> location, std::span<const GLint> depth,
+                              const vox::Palette *palette, std::span<PackedInstance> out)
+    {
+        for (size_t i = 0; i < out.size(); i++)
+        {
+            const GLuint64 key = packKey(location[i], depth[i]);
+            out[i] = {
+                static_cast<GLuint>(key), static_cast<GLuint>(key >> 32),
+                palette ? palette->index(color[i]) : packRgb8(color[i])
+            };
+        }
+    }
+
     class LinearizedVoxel final : public ctx::IRenderable
     {
         std::vector<std::pair<glm::vec3, std::vector<int>>> layout;
@@ -125,19 +201,7 @@ namespace lin
 
     inline void LinearizedVoxel::pre_render()
     {
-        glsl_program = new ctx::Program();
-        const ctx::Shader glsl_vertex_s(
-            "/home/lukas/projects/voxels/shaders/voxel.vert",
-            GL_VERTEX_SHADER
-        );
-        const ctx::Shader glsl_fragment_s(
-            "/home/lukas/projects/voxels/shaders/voxel.frag",
-            GL_FRAGMENT_SHADER
-        );
-
-        glsl_program->attach(glsl_vertex_s);
-        glsl_program->attach(glsl_fragment_s);
-        glsl_program->link();
+        glsl_program = ctx::makeProgram({"voxel.vert", "voxel.frag"});
         glsl_program->use();
 
         model_vao = vox::preDrawCube();
@@ -146,7 +210,7 @@ namespace lin
     class LinVox final : public ctx::IRenderable
     {
         std::vector<glm::vec3> color;
-        std::vector<GLint> location;
+        std::vector<GLuint64> location;
         std::vector<GLint> depth;
         ctx::Program *glsl_program = nullptr;
         GLuint model_vao = 0;
@@ -154,14 +218,75 @@ namespace lin
         float model_scale = 1.f;
         glm::vec3 model_offset = glm::vec3{0, 0, 0};
 
+        std::unique_ptr<vox::Culler> culler;
+        std::vector<DrawElementsIndirectCommand> commands;
+        GLuint indirect_buffer = 0;
+        vox::CullStats cull_stats;
+
+        // edits leave dead instances (depth -1) behind, their slots are reused before the arrays grow
+        GLuint instance_vbo = 0;
+        size_t gpu_capacity = 0;
+        std::vector<PackedInstance> packed;
+        std::vector<uint32_t> free_slots;
+        std::vector<uint32_t> dirty;
+
+        // level of detail replaces the uploaded instances with a per frame selection, culling is off meanwhile
+        std::unique_ptr<vox::LodTree> lod;
+        float lod_pixel_error = 1.f;
+        float lod_hysteresis = 0.f;
+        float lod_min_occupancy = 0.f;
+        vox::LodStats lod_stats;
+        std::vector<glm::vec3> lod_color;
+        std::vector<uint64_t> lod_location, lod_next;
+        std::vector<int32_t> lod_depth;
+        size_t lod_uploaded = 0;
+
+        // colors go up as indices into this instead of rgb8 while set
+        std::unique_ptr<vox::Palette> palette;
+        GLuint palette_ssbo = 0;
+        bool palette_dirty = false;
+
+        // batches of a background build are taken in at render time, cells replace the preview's instances
+        vox::AsyncBuild *source = nullptr;
+        size_t batches_per_frame = 0;
+        size_t preview_end = 0;
+
+        void release(int region_depth, GLuint64 path, size_t first, size_t last);
+        void place(size_t appended);
+        void receive(const vox::InstanceBatch &batch);
+        void mark_dirty(size_t slot);
+        void mark_all_dirty();
+        void upload(size_t first, size_t count, const glm::vec3 *_color, const GLuint64 *_location, const GLint *_depth);
+        void render_lod();
+        void flush();
+
     public:
         explicit LinVox(vox::Octree *layout);
-        void linearize(vox::Octree *node, GLint d, GLint l, GLint d8);
+        explicit LinVox(const vox::Svo &layout);
+        explicit LinVox(const vox::SvoView &layout);
+        LinVox(std::span<const glm::vec3> _color, std::span<const GLuint64> _location, std::span<const GLint> _depth);
+        explicit LinVox(vox::AsyncBuild &build, size_t _batches_per_frame = 16);
+        void linearize(const vox::Octree *node, GLint d, GLuint64 l, GLuint64 d8);
+        void linearize(const vox::SvoView &svo, uint32_t node, GLint d, GLuint64 l, GLuint64 d8);
         void render() override;
         void use_shader() override;
         void pre_render() override;
         void pre_render_cleanup() override;
         void print();
+        void enable_culling(const vox::Octree *layout, unsigned thread_count = std::thread::hardware_concurrency());
+        void enable_lod(const vox::Octree *layout, float pixel_error = 1.f, float hysteresis = 0.25f, float min_occupancy = 0.f);
+        void disable_lod();
+        void enable_palette(int size = vox::PALETTE_MAX);
+        void disable_palette();
+        void update(const vox::EditRegion &region);
+        void compact();
+        [[nodiscard]] size_t live_count() const;
+
+        [[nodiscard]] const vox::CullStats &get_cull_stats() const;
+        [[nodiscard]] const vox::LodStats &get_lod_stats() const;
+        [[nodiscard]] const std::vector<glm::vec3> &get_color() const;
+        [[nodiscard]] const std::vector<GLuint64> &get_location() const;
+        [[nodiscard]] const std::vector<GLint> &get_depth() const;
     };
 
     inline LinVox::LinVox(vox::Octree *layout)
@@ -169,19 +294,275 @@ namespace lin
         linearize(layout, 0, 0, 1);
     }
 
+    inline LinVox::LinVox(const vox::Svo &layout) : LinVox(layout.view())
+    {
+    }
+
+    inline LinVox::LinVox(const vox::SvoView &layout)
+    {
+        if (layout.root == vox::OCTANT_LEAF)
+        {
+            color.push_back(layout.leaves[0]);
+            location.push_back(0);
+            depth.push_back(0);
+        }
+        if (layout.root == vox::OCTANT_NODE) linearize(layout, 0, 1, 0, 1);
+    }
+
+    inline LinVox::LinVox(std::span<const glm::vec3> _color, std::span<const GLuint64> _location, std::span<const GLint> _depth)
+    {
+        color.assign(_color.begin(), _color.end());
+        location.assign(_location.begin(), _location.end());
+        depth.assign(_depth.begin(), _depth.end());
+    }
+
+    // starts empty and grows as the build delivers, at most batches_per_frame batches are taken in per frame
+    // so a burst of finished cells does not stall rendering. build has to outlive the renderer
+    inline LinVox::LinVox(vox::AsyncBuild &build, const size_t _batches_per_frame)
+        : source(&build), batches_per_frame(std::max<size_t>(_batches_per_frame, 1))
+    {
+    }
+
+    // layout has to be the tree the instances were linearized from, its leaf order is what maps
+    // culled nodes back onto instance ranges
+    inline void LinVox::enable_culling(const vox::Octree *layout, const unsigned thread_count)
+    {
+        disable_lod();
+        culler = std::make_unique<vox::Culler>(layout, thread_count);
+        if (culler->instance_count() != location.size())
+        {
+            culler.reset();
+            throw std::runtime_error("Culling tree does not match the linearized instances.");
+        }
+    }
+
+    // layout has to be the tree the instances were linearized from; each frame stops descending once a node
+    // covers less than pixel_error pixels, hysteresis is the fraction by which that threshold favours last frame
+    inline void LinVox::enable_lod(const vox::Octree *layout, const float pixel_error, const float hysteresis, const float min_occupancy)
+    {
+        culler.reset();
+        lod = std::make_unique<vox::LodTree>(layout);
+        lod_pixel_error = pixel_error;
+        lod_hysteresis = hysteresis;
+        lod_min_occupancy = min_occupancy;
+        lod_location.clear();
+    }
+
+    // quantizes the current colors, later edits map to the nearest entry
+    inline void LinVox::enable_palette(const int size)
+    {
+        palette = std::make_unique<vox::Palette>(color, size);
+        palette_dirty = true;
+        mark_all_dirty();
+        lod_location.clear();
+    }
+
+    inline void LinVox::disable_palette()
+    {
+        if (!palette) return;
+        palette.reset();
+        palette_dirty = true;
+        mark_all_dirty();
+        lod_location.clear();
+    }
+
+    inline void LinVox::disable_lod()
+    {
+        if (!lod) return;
+        lod.reset();
+
+        // the buffers hold the last selection, the next flush sends the full instances again
+        gpu_capacity = 0;
+    }
+
+    // kills the instances of slots [first, last) inside the cell (region_depth, path)
+    inline void LinVox::release(const int region_depth, const GLuint64 path, const size_t first, const size_t last)
+    {
+        // instances in the region share its path in their lowest digits and sit at least as deep
+        const GLuint64 mask = (static_cast<GLuint64>(1) << 3 * region_depth) - 1;
+        for (size_t i = first; i < last; i++)
+        {
+            if (depth[i] < region_depth || (location[i] & mask) != path) continue;
+            depth[i] = -1;
+            free_slots.push_back(static_cast<uint32_t>(i));
+            mark_dirty(i);
+        }
+    }
+
+    // moves the instances appended from slot appended on into freed slots, whatever is left stays appended
+    inline void LinVox::place(const size_t appended)
+    {
+        while (location.size() > appended && !free_slots.empty())
+        {
+            const uint32_t slot = free_slots.back();
+            free_slots.pop_back();
+            color[slot] = color.back();
+            location[slot] = location.back();
+            depth[slot] = depth.back();
+            color.pop_back();
+            location.pop_back();
+            depth.pop_back();
+            mark_dirty(slot);
+        }
+        for (size_t i = appended; i < location.size(); i++) mark_dirty(i);
+
+        // slots no longer follow the tree's leaf order, and filtered colors are stale
+        culler.reset();
+        disable_lod();
+
+        if (free_slots.size() > 1024 && free_slots.size() * 4 > location.size()) compact();
+    }
+
+    // swaps the instances inside an edited region for the region's new leaves, only touched slots get uploaded
+    inline void LinVox::update(const vox::EditRegion &region)
+    {
+        if (!region.node) return;
+
+        release(region.depth, region.path, 0, location.size());
+        const size_t appended = location.size();
+        linearize(region.node, region.depth, region.path, static_cast<GLuint64>(1) << 3 * region.depth);
+        place(appended);
+    }
+
+    // the root batch is the preview and replaces everything; a cell can only cover preview instances, which
+    // sit below preview_end (compaction only moves slots down), so cells never scan the instances before them
+    inline void LinVox::receive(const vox::InstanceBatch &batch)
+    {
+        release(batch.depth, batch.path, 0, batch.depth == 0 ? location.size() : std::min(preview_end, location.size()));
+
+        const size_t appended = location.size();
+        color.insert(color.end(), batch.color.begin(), batch.color.end());
+        location.insert(location.end(), batch.location.begin(), batch.location.end());
+        depth.insert(depth.end(), batch.level.begin(), batch.level.end());
+        place(appended);
+
+        if (batch.depth == 0) preview_end = location.size();
+    }
+
+    // drops dead instances, the whole array is uploaded again
+    inline void LinVox::compact()
+    {
+        size_t out = 0;
+        for (size_t i = 0; i < location.size(); i++)
+        {
+            if (depth[i] < 0) continue;
+            color[out] = color[i];
+            location[out] = location[i];
+            depth[out] = depth[i];
+            out++;
+        }
+        color.resize(out);
+        location.resize(out);
+        depth.resize(out);
+        free_slots.clear();
+        mark_all_dirty();
+    }
+
+    inline size_t LinVox::live_count() const
+    {
+        return location.size() - free_slots.size();
+    }
+
+    inline void LinVox::mark_dirty(const size_t slot)
+    {
+        dirty.push_back(static_cast<uint32_t>(slot));
+    }
+
+    inline void LinVox::mark_all_dirty()
+    {
+        dirty.clear();
+        for (size_t i = 0; i < location.size(); i++) dirty.push_back(static_cast<uint32_t>(i));
+    }
+
+    // packs count instances and writes them at slot first of the bound instance buffer
+    inline void LinVox::upload(const size_t first, const size_t count, const glm::vec3 *_color, const GLuint64 *_location, const GLint *_depth)
+    {
+        packed.resize(count);
+        packInstances({_color, count}, {_location, count}, {_depth, count}, palette.get(), packed);
+        glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(PackedInstance), count * sizeof(PackedInstance), packed.data());
+    }
+
+    // uploads dirty slots as merged ranges, buffers grow by half when the instances outgrow them
+    inline void LinVox::flush()
+    {
+        if (location.size() > gpu_capacity)
+        {
+            gpu_capacity = std::max<size_t>(location.size() + location.size() / 2, 1024);
+            glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+            glBufferData(GL_ARRAY_BUFFER, gpu_capacity * sizeof(PackedInstance), nullptr, GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            mark_all_dirty();
+        }
+        if (dirty.empty()) return;
+
+        std::sort(dirty.begin(), dirty.end());
+        dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+        while (!dirty.empty() && dirty.back() >= location.size()) dirty.pop_back();
+        if (dirty.empty()) return;
+
+        glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+        const auto upload_range = [this](const size_t first, const size_t count)
+        {
+            upload(first, count, &color[first], &location[first], &depth[first]);
+        };
+
+        size_t first = dirty[0], last = dirty[0];
+        for (size_t i = 1; i < dirty.size(); i++)
+        {
+            // small gaps are cheaper to re-send than another call
+            if (dirty[i] <= last + 16)
+            {
+                last = dirty[i];
+                continue;
+            }
+            upload_range(first, last - first + 1);
+            first = last = dirty[i];
+        }
+        upload_range(first, last - first + 1);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        dirty.clear();
+    }
+
+    inline const vox::CullStats &LinVox::get_cull_stats() const
+    {
+        return cull_stats;
+    }
+
+    inline const vox::LodStats &LinVox::get_lod_stats() const
+    {
+        return lod_stats;
+    }
+
+    inline const std::vector<glm::vec3> &LinVox::get_color() const
+    {
+        return color;
+    }
+
+    inline const std::vector<GLuint64> &LinVox::get_location() const
+    {
+        return location;
+    }
+
+    inline const std::vector<GLint> &LinVox::get_depth() const
+    {
+        return depth;
+    }
+
     inline void LinVox::print()
     {
         for (int i = 0; i < color.size(); i++)
         {
             std::cout << color[i].r << " " << color[i].g << " " << color[i].b << "; "
-                      <<  std::oct << location[i] << " " << depth[i] << std::endl;
+                      <<  std::oct << location[i] << std::dec << " " << depth[i] << std::endl;
         }
     }
 
 
-    inline void LinVox::linearize(vox::Octree *node, GLint d, GLint l, GLint d8)
+    // l holds the octant path as base 8 digits, level 1 in the lowest digit
+    inline void LinVox::linearize(const vox::Octree *node, GLint d, GLuint64 l, GLuint64 d8)
     {
         if (node->empty()) return;
+        if (d > vox::MAX_DEPTH) throw std::runtime_error("Octree deeper than 64 bit locations can address.");
         if (node->leaf())
         {
             color.push_back(node->get_color());
@@ -199,6 +580,26 @@ namespace lin
         }
     }
 
+    inline void LinVox::linearize(const vox::SvoView &svo, uint32_t node, GLint d, GLuint64 l, GLuint64 d8)
+    {
+        if (d > vox::MAX_DEPTH) throw std::runtime_error("Octree deeper than 64 bit locations can address.");
+        const vox::SvoNode &n = svo.nodes[node];
+        for (int i = 0; i < 8; i++)
+        {
+            if (!(n.valid_mask >> i & 1)) continue;
+
+            if (n.leaf_mask >> i & 1)
+            {
+                color.push_back(svo.leaves[vox::Svo::leaf_index(n, i)]);
+                location.push_back(l + i * d8);
+                depth.push_back(d);
+                continue;
+            }
+
+            linearize(svo, vox::Svo::child_index(n, i), d + 1, l + i * d8, d8 * 8);
+        }
+    }
+
     inline void LinVox::use_shader()
     {
         glsl_program->use();
@@ -206,53 +607,24 @@ namespace lin
 
     inline void LinVox::pre_render()
     {
-        glsl_program = new ctx::Program();
-        const ctx::Shader glsl_vertex_s(
-            "/home/lukas/projects/voxels/shaders/linear.vert",
-            GL_VERTEX_SHADER
-        );
-        const ctx::Shader glsl_fragment_s(
-            "/home/lukas/projects/voxels/shaders/voxel.frag",
-            GL_FRAGMENT_SHADER
-        );
-
-        glsl_program->attach(glsl_vertex_s);
-        glsl_program->attach(glsl_fragment_s);
-        glsl_program->link();
+        glsl_program = ctx::makeProgram({"linear.vert", "voxel.frag"});
         glsl_program->use();
 
         model_vao = vox::preDrawCube();
 
-        GLuint colorVBO, locationVBO, depthVBO;
-        glGenBuffers(1, &colorVBO);
-        glBindBuffer(GL_ARRAY_BUFFER, colorVBO);
-        glBufferData(GL_ARRAY_BUFFER, color.size() * sizeof(glm::vec3), &color[0], GL_STATIC_DRAW);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glGenBuffers(1, &instance_vbo);
+        flush();
+
+        glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
         glEnableVertexAttribArray(5);
-        glBindBuffer(GL_ARRAY_BUFFER, colorVBO);
-        glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), nullptr);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glVertexAttribIPointer(5, 1, GL_UNSIGNED_INT, sizeof(PackedInstance), reinterpret_cast<const void *>(offsetof(PackedInstance, color)));
         glVertexAttribDivisor(5, 1);
 
-        glGenBuffers(1, &locationVBO);
-        glBindBuffer(GL_ARRAY_BUFFER, locationVBO);
-        glBufferData(GL_ARRAY_BUFFER,  location.size() * sizeof(GLint), &location[0], GL_STATIC_DRAW);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        // 64 bit key goes up as uvec2 (low, high) since core GLSL has no 64 bit integer attributes
         glEnableVertexAttribArray(6);
-        glBindBuffer(GL_ARRAY_BUFFER, locationVBO);
-        glVertexAttribIPointer(6, 1, GL_INT, sizeof(GLint), nullptr);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glVertexAttribIPointer(6, 2, GL_UNSIGNED_INT, sizeof(PackedInstance), reinterpret_cast<const void *>(offsetof(PackedInstance, key_low)));
         glVertexAttribDivisor(6, 1);
-
-        glGenBuffers(1, &depthVBO);
-        glBindBuffer(GL_ARRAY_BUFFER, depthVBO);
-        glBufferData(GL_ARRAY_BUFFER, depth.size() * sizeof(GLint), &depth[0], GL_STATIC_DRAW);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glEnableVertexAttribArray(7);
-        glBindBuffer(GL_ARRAY_BUFFER, depthVBO);
-        glVertexAttribIPointer(7, 1, GL_INT, sizeof(GLint), nullptr);
         glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glVertexAttribDivisor(7, 1);
     }
 
     inline void LinVox::render()
@@ -263,8 +635,84 @@ namespace lin
         glProgramUniform1f(glsl_program->get_id(), 1, radians);
         glProgramUniform1f(glsl_program->get_id(), 3, model_scale);
         glProgramUniform3fv(glsl_program->get_id(), 4, 1, glm::value_ptr(model_offset));
+        if (palette_dirty)
+        {
+            const GLsizei entries = palette ? static_cast<GLsizei>(palette->get_colors().size()) : 0;
+            glProgramUniform1i(glsl_program->get_id(), 2, entries);
+            if (entries)
+            {
+                // std430 pads vec3 array elements to 16 bytes
+                std::vector<glm::vec4> colors;
+                colors.reserve(palette->get_colors().size());
+                for (const glm::vec3 c : palette->get_colors()) colors.emplace_back(c, 0.f);
+
+                if (!palette_ssbo) glGenBuffers(1, &palette_ssbo);
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, palette_ssbo);
+                glBufferData(GL_SHADER_STORAGE_BUFFER, colors.size() * sizeof(glm::vec4), colors.data(), GL_STATIC_DRAW);
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            }
+            palette_dirty = false;
+        }
+        if (palette) glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, palette_ssbo);
+
+        if (source)
+        {
+            // read before polling: a cell counts as done only once its batch is queued
+            const bool finished = source->done();
+            vox::InstanceBatch batch;
+            size_t taken = 0;
+            while (taken < batches_per_frame && source->poll(batch))
+            {
+                receive(batch);
+                taken++;
+            }
+            if (finished && taken < batches_per_frame)
+            {
+                // a failed build keeps the cells that made it and is reported once
+                if (const std::exception_ptr error = source->error())
+                {
+                    try
+                    {
+                        std::rethrow_exception(error);
+                    }
+                    catch (const std::exception &e)
+                    {
+                        std::cerr << "[LinVox] Background build failed: " << e.what() << std::endl;
+                    }
+                    catch (...)
+                    {
+                        std::cerr << "[LinVox] Background build failed." << std::endl;
+                    }
+                }
+                source = nullptr;
+            }
+        }
 
+        if (lod)
+        {
+            render_lod();
+            return;
+        }
+
+        flush();
         glBindVertexArray(model_vao);
+        if (culler)
+        {
+            // one indirect command per visible instance range and cube fan, base_instance offsets the instance attributes
+            const auto &ranges = culler->cull(modelRotation(radians), &cull_stats);
+            commands.clear();
+            for (const GLuint first_index : {0u, 8u})
+                for (const vox::InstanceRange &range : ranges)
+                    commands.push_back({8, range.count, first_index, 0, range.first});
+
+            if (!indirect_buffer) glGenBuffers(1, &indirect_buffer);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_buffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STREAM_DRAW);
+            glMultiDrawElementsIndirect(GL_TRIANGLE_FAN, GL_UNSIGNED_INT, nullptr, static_cast<GLsizei>(commands.size()), 0);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+            return;
+        }
+
         glDrawElementsInstanced(
             GL_TRIANGLE_FAN,
             8, GL_UNSIGNED_INT,
@@ -277,6 +725,46 @@ namespace lin
         );
     }
 
+    // the selection only goes up when it differs from the last frame's, which hysteresis makes the common case
+    inline void LinVox::render_lod()
+    {
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        std::vector<int32_t> next_depth;
+        lod->select(
+            modelRotation(radians), static_cast<float>(std::max(viewport[2], viewport[3])),
+            lod_pixel_error, lod_hysteresis,
+            lod_color, lod_next, next_depth, &lod_stats, lod_min_occupancy
+        );
+
+        if (gpu_capacity || lod_next != lod_location || next_depth != lod_depth)
+        {
+            lod_location.swap(lod_next);
+            lod_depth.swap(next_depth);
+            lod_uploaded = lod_location.size();
+
+            glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+            glBufferData(GL_ARRAY_BUFFER, lod_uploaded * sizeof(PackedInstance), nullptr, GL_STREAM_DRAW);
+            if (lod_uploaded) upload(0, lod_uploaded, lod_color.data(), lod_location.data(), lod_depth.data());
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+            // full instances have to be sent again once level of detail is off
+            gpu_capacity = 0;
+        }
+
+        glBindVertexArray(model_vao);
+        glDrawElementsInstanced(
+            GL_TRIANGLE_FAN,
+            8, GL_UNSIGNED_INT,
+            nullptr, static_cast<GLsizei>(lod_uploaded)
+        );
+        glDrawElementsInstanced(
+            GL_TRIANGLE_FAN,
+            8, GL_UNSIGNED_INT,
+            reinterpret_cast<const void *>(8 * sizeof(float)), static_cast<GLsizei>(lod_uploaded)
+        );
+    }
+
     inline void LinVox::pre_render_cleanup()
     {
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -0,0 +1,368 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+#include <glm/vec3.hpp>
+#include "voxel.hpp"
+#include "morton.hpp"
+#include "interfaces.hpp"
+
+namespace vox
+{
+    // deepest level holding a leaf, 0 for a root leaf or an empty tree
+    inline int leafDepth(const Octree *node)
+    {
+        if (!node->node()) return 0;
+
+        int depth = 0;
+        for (const Octree *child : node->get_children()) depth = std::max(depth, leafDepth(child) + 1);
+        return depth;
+    }
+
+    // axis aligned face in integer cells of the finest level; u, v are the two axes following axis
+    struct MeshQuad
+    {
+        uint8_t axis;
+        uint8_t side;       // 1 when the face looks towards +axis
+        uint32_t plane;
+        uint32_t u0, v0, u1, v1;
+        glm::vec3 color;
+    };
+
+    struct MeshStats
+    {
+        size_t leaves = 0;
+        size_t faces = 0;       // exposed faces before merging
+        size_t quads = 0;
+        size_t triangles = 0;
+        double build_ms = 0;
+    };
+
+    class FaceExtractor
+    {
+        const Octree *root;
+        int max_depth;
+        std::vector<MeshQuad> &quads;
+
+        [[nodiscard]] const Octree *descend(int depth, uint32_t x, uint32_t y, uint32_t z) const;
+        void emit(int depth, const uint32_t *cell, int axis, int side, glm::vec3 color);
+        void emitUncovered(const Octree *neighbour, int depth, const uint32_t *cell, int axis, int side, glm::vec3 color);
+        void leafFaces(int depth, const uint32_t *cell, glm::vec3 color);
+
+    public:
+        FaceExtractor(const Octree *_root, std::vector<MeshQuad> &_quads);
+        void extract(const Octree *node, int depth, uint32_t x, uint32_t y, uint32_t z);
+        size_t leaves = 0;
+    };
+
+    inline FaceExtractor::FaceExtractor(const Octree *_root, std::vector<MeshQuad> &_quads)
+        : root(_root), max_depth(leafDepth(_root)), quads(_quads)
+    {
+        if (max_depth > MAX_DEPTH) throw std::runtime_error("Octree too deep to mesh.");
+    }
+
+    // node covering cell (x, y, z) of the given level, or the coarser leaf/empty containing it
+    inline const Octree *FaceExtractor::descend(const int depth, const uint32_t x, const uint32_t y, const uint32_t z) const
+    {
+        const Octree *node = root;
+        for (int level = 1; level <= depth && node->node(); level++)
+        {
+            const int bit = depth - level;
+            const int code = (x >> bit & 1) | (y >> bit & 1) << 1 | (z >> bit & 1) << 2;
+            node = node->get_children()[MORTON_OCTANTS[code]];
+        }
+        return node;
+    }
+
+    // face of the given cell on its axis/side, scaled to the finest level
+    inline void FaceExtractor::emit(const int depth, const uint32_t *cell, const int axis, const int side, const glm::vec3 color)
+    {
+        const int shift = max_depth - depth;
+        const int u = (axis + 1) % 3;
+        const int v = (axis + 2) % 3;
+        quads.push_back({
+            static_cast<uint8_t>(axis), static_cast<uint8_t>(side),
+            (cell[axis] + side) << shift,
+            cell[u] << shift, cell[v] << shift,
+            (cell[u] + 1) << shift, (cell[v] + 1) << shift,
+            color
+        });
+    }
+
+    // neighbour is subdivided: only the parts touching empty space are visible
+    inline void FaceExtractor::emitUncovered(const Octree *neighbour, const int depth, const uint32_t *cell, const int axis, const int side, const glm::vec3 color)
+    {
+        if (neighbour->leaf()) return;
+        if (neighbour->empty())
+        {
+            // the face lies on the neighbour's far side from its own point of view
+            uint32_t own[3] = {cell[0], cell[1], cell[2]};
+            own[axis] += side ? -1 : 1;
+            emit(depth, own, axis, side, color);
+            return;
+        }
+
+        const auto children = neighbour->get_children();
+        for (int code = 0; code < 8; code++)
+        {
+            // children of the neighbour that touch the shared plane
+            if ((code >> axis & 1) != (side ? 0 : 1)) continue;
+
+            const uint32_t child[3] = {
+                cell[0] * 2 + (code & 1),
+                cell[1] * 2 + (code >> 1 & 1),
+                cell[2] * 2 + (code >> 2 & 1)
+            };
+            emitUncovered(children[MORTON_OCTANTS[code]], depth + 1, child, axis, side, color);
+        }
+    }
+
+    inline void FaceExtractor::leafFaces(const int depth, const uint32_t *cell, const glm::vec3 color)
+    {
+        const uint32_t cells = 1u << depth;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            for (int side = 0; side < 2; side++)
+            {
+                if (side ? cell[axis] + 1 == cells : cell[axis] == 0)
+                {
+                    emit(depth, cell, axis, side, color);
+                    continue;
+                }
+
+                uint32_t next[3] = {cell[0], cell[1], cell[2]};
+                next[axis] += side ? 1 : -1;
+                const Octree *neighbour = descend(depth, next[0], next[1], next[2]);
+                if (neighbour->leaf()) continue;
+                if (neighbour->empty()) emit(depth, cell, axis, side, color);
+                else emitUncovered(neighbour, depth, next, axis, side, color);
+            }
+        }
+    }
+
+    inline void FaceExtractor::extract(const Octree *node, const int depth, const uint32_t x, const uint32_t y, const uint32_t z)
+    {
+        if (node->empty()) return;
+        if (node->leaf())
+        {
+            const uint32_t cell[3] = {x, y, z};
+            leafFaces(depth, cell, node->get_color());
+            leaves++;
+            return;
+        }
+
+        const auto children = node->get_children();
+        for (int code = 0; code < 8; code++)
+            extract(children[MORTON_OCTANTS[code]], depth + 1, x * 2 + (code & 1), y * 2 + (code >> 1 & 1), z * 2 + (code >> 2 & 1));
+    }
+
+    // every leaf face that borders empty space or the model bounds
+    inline std::vector<MeshQuad> exposedFaces(const Octree *tree, size_t *leaves = nullptr)
+    {
+        std::vector<MeshQuad> quads;
+        FaceExtractor extractor(tree, quads);
+        extractor.extract(tree, 0, 0, 0, 0);
+        if (leaves) *leaves = extractor.leaves;
+        return quads;
+    }
+
+    inline auto quadPlaneKey(const MeshQuad &q)
+    {
+        return std::make_tuple(q.axis, q.side, q.plane,
+            std::bit_cast<uint32_t>(q.color.r), std::bit_cast<uint32_t>(q.color.g), std::bit_cast<uint32_t>(q.color.b));
+    }
+
+    // merges coplanar same colored faces: runs along u first, then equally wide runs along v
+    inline void mergeFaces(std::vector<MeshQuad> &quads)
+    {
+        const auto merge = [&quads](auto &&order, auto &&adjacent, auto &&grow)
+        {
+            std::sort(quads.begin(), quads.end(), order);
+
+            size_t out = 0;
+            for (size_t i = 0; i < quads.size(); i++)
+            {
+                if (out > 0 && adjacent(quads[out - 1], quads[i])) grow(quads[out - 1], quads[i]);
+                else quads[out++] = quads[i];
+            }
+            quads.resize(out);
+        };
+
+        merge(
+            [](const MeshQuad &a, const MeshQuad &b)
+            {
+                return std::tuple_cat(quadPlaneKey(a), std::tie(a.v0, a.v1, a.u0)) < std::tuple_cat(quadPlaneKey(b), std::tie(b.v0, b.v1, b.u0));
+            },
+            [](const MeshQuad &a, const MeshQuad &b)
+            {
+                return quadPlaneKey(a) == quadPlaneKey(b) && a.v0 == b.v0 && a.v1 == b.v1 && a.u1 == b.u0;
+            },
+            [](MeshQuad &a, const MeshQuad &b) { a.u1 = b.u1; }
+        );
+
+        merge(
+            [](const MeshQuad &a, const MeshQuad &b)
+            {
+                return std::tuple_cat(quadPlaneKey(a), std::tie(a.u0, a.u1, a.v0)) < std::tuple_cat(quadPlaneKey(b), std::tie(b.u0, b.u1, b.v0));
+            },
+            [](const MeshQuad &a, const MeshQuad &b)
+            {
+                return quadPlaneKey(a) == quadPlaneKey(b) && a.u0 == b.u0 && a.u1 == b.u1 && a.v1 == b.v0;
+            },
+            [](MeshQuad &a, const MeshQuad &b) { a.v1 = b.v1; }
+        );
+    }
+}
+
+namespace lin
+{
+    struct MeshVertex
+    {
+        glm::vec3 position;
+        glm::vec3 color;
+    };
+
+    // draws only the exposed leaf faces as plain indexed triangles, optionally greedily merged
+    class MeshVox final : public ctx::IRenderable
+    {
+        std::vector<MeshVertex> vertices;
+        std::vector<GLuint> indices;
+        vox::MeshStats stats;
+        ctx::Program *glsl_program = nullptr;
+        GLuint model_vao = 0;
+        float radians = 0;
+        float model_scale = 1.f;
+        glm::vec3 model_offset = glm::vec3{0, 0, 0};
+
+        void triangulate(const std::vector<vox::MeshQuad> &quads, int max_depth);
+
+    public:
+        explicit MeshVox(const vox::Octree *layout, bool greedy = true);
+        void render() override;
+        void use_shader() override;
+        void pre_render() override;
+        void pre_render_cleanup() override;
+
+        [[nodiscard]] const vox::MeshStats &get_stats() const;
+        [[nodiscard]] const std::vector<MeshVertex> &get_vertices() const;
+        [[nodiscard]] const std::vector<GLuint> &get_indices() const;
+    };
+
+    inline MeshVox::MeshVox(const vox::Octree *layout, const bool greedy)
+    {
+        const auto start = std::chrono::steady_clock::now();
+
+        std::vector<vox::MeshQuad> quads = vox::exposedFaces(layout, &stats.leaves);
+        stats.faces = quads.size();
+        if (greedy) vox::mergeFaces(quads);
+        triangulate(quads, vox::leafDepth(layout));
+
+        stats.quads = quads.size();
+        stats.triangles = indices.size() / 3;
+        stats.build_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // model space spans -0.5..0.5 like LinVox; front faces wind so that their cross product points outwards,
+    // which is what glFrontFace(GL_CW) sees without a projection flipping z
+    inline void MeshVox::triangulate(const std::vector<vox::MeshQuad> &quads, const int max_depth)
+    {
+        const float cell = 1.f / static_cast<float>(1u << max_depth);
+        vertices.reserve(quads.size() * 4);
+        indices.reserve(quads.size() * 6);
+
+        for (const vox::MeshQuad &q : quads)
+        {
+            const int u = (q.axis + 1) % 3;
+            const int v = (q.axis + 2) % 3;
+            const uint32_t corners[4][2] = {{q.u0, q.v0}, {q.u1, q.v0}, {q.u1, q.v1}, {q.u0, q.v1}};
+
+            const auto first = static_cast<GLuint>(vertices.size());
+            for (int k = 0; k < 4; k++)
+            {
+                // -axis faces walk the corners backwards to flip the winding
+                const auto &corner = corners[q.side ? k : 3 - k];
+                glm::vec3 position;
+                position[q.axis] = static_cast<float>(q.plane) * cell - 0.5f;
+                position[u] = static_cast<float>(corner[0]) * cell - 0.5f;
+                position[v] = static_cast<float>(corner[1]) * cell - 0.5f;
+                vertices.push_back({position, q.color});
+            }
+
+            for (const GLuint k : {0u, 1u, 2u, 0u, 2u, 3u}) indices.push_back(first + k);
+        }
+    }
+
+    inline const vox::MeshStats &MeshVox::get_stats() const
+    {
+        return stats;
+    }
+
+    inline const std::vector<MeshVertex> &MeshVox::get_vertices() const
+    {
+        return vertices;
+    }
+
+    inline const std::vector<GLuint> &MeshVox::get_indices() const
+    {
+        return indices;
+    }
+
+    inline void MeshVox::use_shader()
+    {
+        glsl_program->use();
+    }
+
+    inline void MeshVox::pre_render()
+    {
+        glsl_program = ctx::makeProgram({"mesh.vert", "voxel.frag"});
+        glsl_program->use();
+
+        glCreateVertexArrays(1, &model_vao);
+
+        GLuint vbo, ebo;
+        glCreateBuffers(1, &vbo);
+        glNamedBufferStorage(vbo, vertices.size() * sizeof(MeshVertex), vertices.data(), 0);
+        glVertexArrayVertexBuffer(model_vao, 0, vbo, 0, sizeof(MeshVertex));
+
+        glEnableVertexArrayAttrib(model_vao, 0);
+        glVertexArrayAttribFormat(model_vao, 0, 3, GL_FLOAT, GL_FALSE, offsetof(MeshVertex, position));
+        glVertexArrayAttribBinding(model_vao, 0, 0);
+        glEnableVertexArrayAttrib(model_vao, 5);
+        glVertexArrayAttribFormat(model_vao, 5, 3, GL_FLOAT, GL_FALSE, offsetof(MeshVertex, color));
+        glVertexArrayAttribBinding(model_vao, 5, 0);
+
+        glCreateBuffers(1, &ebo);
+        glNamedBufferStorage(ebo, indices.size() * sizeof(GLuint), indices.data(), 0);
+        glVertexArrayElementBuffer(model_vao, ebo);
+    }
+
+    inline void MeshVox::render()
+    {
+        radians += 0.01;
+        if (radians >= glm::two_pi<float>()) radians = 0;
+
+        glProgramUniform1f(glsl_program->get_id(), 1, radians);
+        glProgramUniform1f(glsl_program->get_id(), 3, model_scale);
+        glProgramUniform3fv(glsl_program->get_id(), 4, 1, glm::value_ptr(model_offset));
+
+        glBindVertexArray(model_vao);
+        glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(indices.size()), GL_UNSIGNED_INT, nullptr);
+    }
+
+    inline void MeshVox::pre_render_cleanup()
+    {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glClearColor(1.0,1.0,1.0,1.0);
+        glEnable(GL_DEPTH_TEST);
+        glDepthFunc(GL_LESS);
+        glFrontFace(GL_CW);
+        glEnable(GL_CULL_FACE);
+        glCullFace(GL_BACK);
+    }
+}
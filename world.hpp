@@ -0,0 +1,374 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+#include "voxel.hpp"
+#include "generators.hpp"
+#include "svo.hpp"
+#include "model_file.hpp"
+#include "pool.hpp"
+#include "queue.hpp"
+#include "scene.hpp"
+
+// a world is a sparse grid of chunks, each an ordinary model in its own unit cell. chunk (x, y, z) covers
+// [x, x + 1) * chunk_size on every axis in world units, and lives in the model file "x_y_z.voxm"
+namespace vox
+{
+    struct ChunkKey
+    {
+        int32_t x = 0, y = 0, z = 0;
+
+        bool operator==(const ChunkKey &other) const = default;
+    };
+
+    struct ChunkKeyHash
+    {
+        size_t operator()(const ChunkKey &key) const
+        {
+            const uint64_t h = static_cast<uint64_t>(static_cast<uint32_t>(key.x)) * 0x9e3779b97f4a7c15ull
+                             ^ static_cast<uint64_t>(static_cast<uint32_t>(key.y)) * 0xc2b2ae3d27d4eb4full
+                             ^ static_cast<uint64_t>(static_cast<uint32_t>(key.z)) * 0x165667b19e3779f9ull;
+            return static_cast<size_t>(h ^ h >> 29);
+        }
+    };
+
+    struct WorldLayout
+    {
+        double chunk_size = 1.0;    // world units per chunk edge
+        int chunk_depth = 8;        // octree depth inside a chunk, the voxel edge is chunk_size / 2^chunk_depth
+    };
+
+    inline ChunkKey chunkAt(const glm::dvec3 point, const WorldLayout &layout)
+    {
+        return {
+            static_cast<int32_t>(std::floor(point.x / layout.chunk_size)),
+            static_cast<int32_t>(std::floor(point.y / layout.chunk_size)),
+            static_cast<int32_t>(std::floor(point.z / layout.chunk_size))
+        };
+    }
+
+    inline glm::dvec3 chunkCenter(const ChunkKey key, const WorldLayout &layout)
+    {
+        return glm::dvec3{key.x + 0.5, key.y + 0.5, key.z + 0.5} * layout.chunk_size;
+    }
+
+    inline std::string chunkPath(const std::string &directory, const ChunkKey key)
+    {
+        return directory + "/" + std::to_string(key.x) + "_" + std::to_string(key.y) + "_" + std::to_string(key.z) + ".voxm";
+    }
+
+    inline bool parseChunkName(const std::string &name, ChunkKey &key)
+    {
+        const char *p = name.data();
+        const char *end = name.data() + name.size();
+        for (int32_t *v : {&key.x, &key.y, &key.z})
+        {
+            const auto [next, error] = std::from_chars(p, end, *v);
+            if (error != std::errc{} || next == end) return false;
+            p = next + 1;
+            if (*next != (v == &key.z ? '.' : '_')) return false;
+        }
+        return std::string_view(p - 1, end) == ".voxm";
+    }
+
+    // buckets the points by chunk and writes every non-empty chunk as a model file, built in chunk local
+    // coordinates so precision does not depend on how far the chunk is from the world origin. existing
+    // files of the same chunks are replaced; returns the number of chunks written
+    inline size_t writeWorldChunks(const PointCloud &point_cloud, const std::string &directory, const WorldLayout &layout,
+                                   const unsigned thread_count = std::thread::hardware_concurrency())
+    {
+        std::filesystem::create_directories(directory);
+
+        std::unordered_map<ChunkKey, PointCloud, ChunkKeyHash> buckets;
+        for (const auto &[coord, col] : point_cloud)
+        {
+            const glm::dvec3 point{coord.x, coord.y, coord.z};
+            const ChunkKey key = chunkAt(point, layout);
+            const glm::dvec3 local = (point - chunkCenter(key, layout)) / layout.chunk_size;
+            buckets[key].emplace_back(glm::vec3{static_cast<float>(local.x), static_cast<float>(local.y), static_cast<float>(local.z)}, col);
+        }
+
+        ThreadPool pool(thread_count);
+        for (auto &[key, points] : buckets)
+            pool.submit([&directory, &layout, key, &points]
+            {
+                OctreeArena arena;
+                Octree *tree = mortonPointCloud(points, glm::vec3{0, 0, 0}, 0.5f, layout.chunk_depth, &arena);
+                tree->cull();
+                const lin::LinVox instances(tree);
+                saveModel(chunkPath(directory, key), Svo(tree), &instances);
+            });
+        pool.wait();
+        return buckets.size();
+    }
+
+    struct WorldChanges
+    {
+        std::vector<ChunkKey> loaded;
+        std::vector<ChunkKey> evicted;
+        // chunks whose file could not be mapped and why, they are not tried again
+        std::vector<std::pair<ChunkKey, std::string>> failed;
+    };
+
+    struct WorldStats
+    {
+        size_t resident = 0;
+        size_t resident_bytes = 0;
+        size_t pending = 0;
+        size_t loads = 0;
+        size_t evictions = 0;
+        size_t failures = 0;
+    };
+
+    // keeps the chunks around a focus point mapped, nearest first, within a byte budget. files are mapped and
+    // paged in on I/O threads and handed over through a lock-free queue; update() on the owning thread applies
+    // them and evicts the least recently wanted chunks once the budget is exceeded. instance_bytes is what a
+    // renderer keeps per instance of a resident chunk, it counts against the budget with the file
+    class PagedWorld
+    {
+        struct Resident
+        {
+            std::unique_ptr<MappedModel> model;
+            size_t bytes;
+            std::list<ChunkKey>::iterator lru;
+        };
+
+        struct Loaded
+        {
+            ChunkKey key;
+            std::unique_ptr<MappedModel> model;
+            std::string error;
+        };
+
+        std::string directory;
+        WorldLayout layout;
+        size_t memory_budget;
+        size_t instance_bytes;
+        int load_radius;
+
+        std::unordered_map<ChunkKey, size_t, ChunkKeyHash> available;   // chunk files and their sizes
+        std::unordered_map<ChunkKey, Resident, ChunkKeyHash> resident;
+        std::list<ChunkKey> lru;                                       // front was wanted most recently
+        std::unordered_map<ChunkKey, size_t, ChunkKeyHash> pending;
+        size_t resident_bytes = 0;
+        size_t pending_bytes = 0;
+        WorldStats stats;
+
+        BoundedQueue<Loaded> loaded;
+        ThreadPool io;
+
+        void evict(ChunkKey key, WorldChanges &changes);
+
+    public:
+        PagedWorld(std::string _directory, const WorldLayout &_layout, size_t _memory_budget, int _load_radius = 2,
+                   unsigned io_threads = 2, size_t _instance_bytes = 0);
+        ~PagedWorld();
+        PagedWorld(const PagedWorld &) = delete;
+        PagedWorld &operator=(const PagedWorld &) = delete;
+
+        // call once per frame; load_radius is in chunks around the chunk containing focus
+        WorldChanges update(glm::dvec3 focus);
+        [[nodiscard]] const MappedModel *find(ChunkKey key) const;
+        [[nodiscard]] const WorldLayout &get_layout() const;
+        [[nodiscard]] const WorldStats &get_stats() const;
+    };
+
+    inline PagedWorld::PagedWorld(std::string _directory, const WorldLayout &_layout, const size_t _memory_budget,
+                                  const int _load_radius, const unsigned io_threads, const size_t _instance_bytes)
+        : directory(std::move(_directory)), layout(_layout), memory_budget(_memory_budget), instance_bytes(_instance_bytes),
+          load_radius(std::max(_load_radius, 0)),
+          loaded(256), io(io_threads)
+    {
+        if (!std::filesystem::is_directory(directory)) throw std::runtime_error("World directory does not exist: " + directory);
+
+        for (const auto &entry : std::filesystem::directory_iterator(directory))
+        {
+            ChunkKey key;
+            if (entry.is_regular_file() && parseChunkName(entry.path().filename().string(), key))
+                available[key] = static_cast<size_t>(entry.file_size());
+        }
+    }
+
+    inline PagedWorld::~PagedWorld()
+    {
+        // loads still in flight finish into the queue, which goes away with the world
+        io.wait();
+    }
+
+    inline void PagedWorld::evict(const ChunkKey key, WorldChanges &changes)
+    {
+        const auto it = resident.find(key);
+        resident_bytes -= it->second.bytes;
+        lru.erase(it->second.lru);
+        resident.erase(it);
+        changes.evicted.push_back(key);
+        stats.evictions++;
+    }
+
+    inline WorldChanges PagedWorld::update(const glm::dvec3 focus)
+    {
+        WorldChanges changes;
+
+        for (Loaded load; loaded.try_pop(load);)
+        {
+            pending_bytes -= pending[load.key];
+            pending.erase(load.key);
+            if (!load.model)
+            {
+                available.erase(load.key);
+                changes.failed.emplace_back(load.key, std::move(load.error));
+                stats.failures++;
+                continue;
+            }
+
+            const size_t bytes = available[load.key] + load.model->instance_location().size() * instance_bytes;
+
+            lru.push_back(load.key);
+            resident[load.key] = {std::move(load.model), bytes, std::prev(lru.end())};
+            resident_bytes += bytes;
+            changes.loaded.push_back(load.key);
+            stats.loads++;
+        }
+
+        // wanted chunks nearest first, resident ones move to the front of the lru in that order
+        const ChunkKey center = chunkAt(focus, layout);
+        std::vector<std::pair<double, ChunkKey>> wanted;
+        for (int z = -load_radius; z <= load_radius; z++)
+            for (int y = -load_radius; y <= load_radius; y++)
+                for (int x = -load_radius; x <= load_radius; x++)
+                {
+                    const ChunkKey key{center.x + x, center.y + y, center.z + z};
+                    if (!available.contains(key)) continue;
+                    const glm::dvec3 d = chunkCenter(key, layout) - focus;
+                    const double distance = d.x * d.x + d.y * d.y + d.z * d.z;
+                    if (distance > (load_radius + 0.5) * (load_radius + 0.5) * layout.chunk_size * layout.chunk_size) continue;
+                    wanted.emplace_back(distance, key);
+                }
+        std::sort(wanted.begin(), wanted.end(), [](const auto &l, const auto &r) { return l.first < r.first; });
+
+        for (auto it = wanted.rbegin(); it != wanted.rend(); ++it)
+            if (const auto found = resident.find(it->second); found != resident.end())
+                lru.splice(lru.begin(), lru, found->second.lru);
+
+        // chunks that are no longer wanted make room, the lru tail holds them oldest first
+        std::unordered_set<ChunkKey, ChunkKeyHash> wanted_set;
+        for (const auto &[distance, key] : wanted) wanted_set.insert(key);
+        const auto over_budget = [this](const size_t extra) { return resident_bytes + pending_bytes + extra > memory_budget; };
+        while (!lru.empty() && over_budget(0) && !wanted_set.contains(lru.back())) evict(lru.back(), changes);
+
+        for (const auto &[distance, key] : wanted)
+        {
+            if (resident.contains(key) || pending.contains(key)) continue;
+
+            // every instance takes at least a color, a location and a depth in the file, so this bounds the
+            // renderer's share until the header says exactly
+            const size_t file_bytes = available[key];
+            const size_t bytes = file_bytes + file_bytes / (sizeof(glm::vec3) + sizeof(GLuint64) + sizeof(GLint)) * instance_bytes;
+            while (!lru.empty() && over_budget(bytes) && !wanted_set.contains(lru.back())) evict(lru.back(), changes);
+            // farther chunks would only push out nearer ones
+            if (over_budget(bytes)) break;
+            // in flight loads never outnumber the queue's cells, so I/O threads never wait on it
+            if (pending.size() >= 256) break;
+
+            pending[key] = bytes;
+            pending_bytes += bytes;
+            io.submit([this, key]
+            {
+                Loaded load{key, nullptr, {}};
+                try
+                {
+                    load.model = std::make_unique<MappedModel>(chunkPath(directory, key));
+                    load.model->prefault();
+                }
+                catch (const std::exception &e)
+                {
+                    load.error = e.what();
+                    load.model.reset();
+                }
+                while (!loaded.try_push(std::move(load))) std::this_thread::yield();
+            });
+        }
+
+        stats.resident = resident.size();
+        stats.resident_bytes = resident_bytes;
+        stats.pending = pending.size();
+        return changes;
+    }
+
+    inline const MappedModel *PagedWorld::find(const ChunkKey key) const
+    {
+        const auto it = resident.find(key);
+        return it == resident.end() ? nullptr : it->second.model.get();
+    }
+
+    inline const WorldLayout &PagedWorld::get_layout() const
+    {
+        return layout;
+    }
+
+    inline const WorldStats &PagedWorld::get_stats() const
+    {
+        return stats;
+    }
+}
+
+namespace lin
+{
+    // mirrors the resident chunks of a world as models of a scene. chunks are placed relative to the focus in
+    // double precision, view_extent is the world distance the scene's unit cell spans. the world should be
+    // given Scene::INSTANCE_BYTES, so the scene's copies of the chunks count against its budget
+    class WorldScene
+    {
+        Scene &scene;
+        std::unordered_map<vox::ChunkKey, size_t, vox::ChunkKeyHash> models;
+
+    public:
+        explicit WorldScene(Scene &_scene);
+        void sync(const vox::PagedWorld &world, const vox::WorldChanges &changes, glm::dvec3 focus, double view_extent);
+    };
+
+    inline WorldScene::WorldScene(Scene &_scene) : scene(_scene)
+    {
+    }
+
+    inline void WorldScene::sync(const vox::PagedWorld &world, const vox::WorldChanges &changes, const glm::dvec3 focus, const double view_extent)
+    {
+        for (const vox::ChunkKey key : changes.evicted)
+        {
+            const auto it = models.find(key);
+            if (it == models.end()) continue;
+            scene.remove(it->second);
+            models.erase(it);
+        }
+        for (const vox::ChunkKey key : changes.loaded)
+        {
+            const vox::MappedModel *chunk = world.find(key);
+            if (!chunk) continue;
+            models[key] = scene.add(chunk->instance_color(), chunk->instance_location(), chunk->instance_depth());
+        }
+
+        const vox::WorldLayout &layout = world.get_layout();
+        const auto scale = static_cast<float>(layout.chunk_size / view_extent);
+        for (const auto &[key, model] : models)
+        {
+            const glm::dvec3 offset = (vox::chunkCenter(key, layout) - focus) / view_extent;
+            glm::mat4 transform{scale};
+            transform[3] = glm::vec4{static_cast<float>(offset.x), static_cast<float>(offset.y), static_cast<float>(offset.z), 1.f};
+            scene.set_transform(model, transform);
+        }
+    }
+}